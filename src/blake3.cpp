@@ -0,0 +1,414 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "blake3.h"
+#include "executor.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define BLAKE3_USE_SSE2
+#    include <emmintrin.h>
+#endif
+
+namespace {
+using ChainingValue = Blake3::ChainingValue;
+using BlockWords = std::array<uint32_t, 16>;
+
+constexpr ChainingValue IV = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                              0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+constexpr std::array<uint8_t, 16> msgPermutation = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+constexpr size_t blocksPerChunk = Blake3::chunkSize / Blake3::blockSize;
+
+// Domain flags
+constexpr uint32_t CHUNK_START = 1 << 0;
+constexpr uint32_t CHUNK_END = 1 << 1;
+constexpr uint32_t PARENT = 1 << 2;
+constexpr uint32_t ROOT = 1 << 3;
+
+/// Chunks hashed at once by a leaf subtree. Must be a power of 2
+constexpr size_t leafChunks = 64;
+/// Minimum number of chunks of a subtree to split it into tasks
+constexpr size_t minTaskChunks = 16 * leafChunks;
+
+uint32_t rotr(uint32_t value, unsigned bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+uint32_t loadLE(const uint8_t* data)
+{
+    return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8
+           | static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+}
+
+BlockWords loadBlock(const uint8_t* block)
+{
+    BlockWords words;
+    for(unsigned i = 0; i < words.size(); i++)
+        words[i] = loadLE(block + i * 4);
+    return words;
+}
+
+void g(std::array<uint32_t, 16>& s, unsigned a, unsigned b, unsigned c, unsigned d, uint32_t mx, uint32_t my)
+{
+    s[a] = s[a] + s[b] + mx;
+    s[d] = rotr(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + my;
+    s[d] = rotr(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 7);
+}
+
+std::array<uint32_t, 16> compress(const ChainingValue& cv, BlockWords m, uint64_t counter, uint32_t blockLen,
+                                  uint32_t flags)
+{
+    std::array<uint32_t, 16> s = {cv[0],
+                                  cv[1],
+                                  cv[2],
+                                  cv[3],
+                                  cv[4],
+                                  cv[5],
+                                  cv[6],
+                                  cv[7],
+                                  IV[0],
+                                  IV[1],
+                                  IV[2],
+                                  IV[3],
+                                  static_cast<uint32_t>(counter),
+                                  static_cast<uint32_t>(counter >> 32),
+                                  blockLen,
+                                  flags};
+    for(unsigned round = 0; round < 7; round++)
+    {
+        g(s, 0, 4, 8, 12, m[0], m[1]);
+        g(s, 1, 5, 9, 13, m[2], m[3]);
+        g(s, 2, 6, 10, 14, m[4], m[5]);
+        g(s, 3, 7, 11, 15, m[6], m[7]);
+        g(s, 0, 5, 10, 15, m[8], m[9]);
+        g(s, 1, 6, 11, 12, m[10], m[11]);
+        g(s, 2, 7, 8, 13, m[12], m[13]);
+        g(s, 3, 4, 9, 14, m[14], m[15]);
+        BlockWords permuted;
+        for(unsigned i = 0; i < m.size(); i++)
+            permuted[i] = m[msgPermutation[i]];
+        m = permuted;
+    }
+    for(unsigned i = 0; i < 8; i++)
+    {
+        s[i] ^= s[i + 8];
+        s[i + 8] ^= cv[i];
+    }
+    return s;
+}
+
+ChainingValue toCv(const std::array<uint32_t, 16>& state)
+{
+    ChainingValue cv;
+    std::copy_n(state.begin(), cv.size(), cv.begin());
+    return cv;
+}
+
+/// Inputs to the final compression of a node, which may be used as a chaining value or as the root
+struct Output
+{
+    ChainingValue cv;
+    BlockWords block;
+    uint64_t counter;
+    uint32_t blockLen;
+    uint32_t flags;
+
+    ChainingValue chainingValue() const { return toCv(compress(cv, block, counter, blockLen, flags)); }
+    std::string rootDigest() const
+    {
+        const auto state = compress(cv, block, 0, blockLen, flags | ROOT);
+        static constexpr char hexDigits[] = "0123456789abcdef";
+        std::string result;
+        result.reserve(Blake3::digestSize * 2);
+        for(unsigned i = 0; i < Blake3::digestSize; i++)
+        {
+            const auto value = static_cast<uint8_t>(state[i / 4] >> (8 * (i % 4)));
+            result += hexDigits[value >> 4];
+            result += hexDigits[value & 0xF];
+        }
+        return result;
+    }
+};
+
+Output parentOutput(const ChainingValue& left, const ChainingValue& right)
+{
+    BlockWords block;
+    std::copy(left.begin(), left.end(), block.begin());
+    std::copy(right.begin(), right.end(), block.begin() + left.size());
+    return Output{IV, block, 0, Blake3::blockSize, PARENT};
+}
+
+/// Output of a single chunk of at most chunkSize bytes
+Output chunkOutput(const uint8_t* data, size_t size, uint64_t chunkCounter)
+{
+    ChainingValue cv = IV;
+    uint32_t startFlag = CHUNK_START;
+    // All blocks but the last one (which may be partial) are compressed directly
+    for(; size > Blake3::blockSize; data += Blake3::blockSize, size -= Blake3::blockSize)
+    {
+        cv = toCv(compress(cv, loadBlock(data), chunkCounter, Blake3::blockSize, startFlag));
+        startFlag = 0;
+    }
+    std::array<uint8_t, Blake3::blockSize> lastBlock{};
+    std::copy_n(data, size, lastBlock.begin());
+    return Output{cv, loadBlock(lastBlock.data()), chunkCounter, static_cast<uint32_t>(size), startFlag | CHUNK_END};
+}
+
+/// Output of a partially hashed chunk (Blake3::ChunkState)
+template<class T_ChunkState>
+Output chunkStateOutput(const T_ChunkState& state)
+{
+    const uint32_t startFlag = state.blocksCompressed == 0 ? CHUNK_START : 0;
+    return Output{state.cv, loadBlock(state.block.data()), state.chunkCounter, state.blockLen, startFlag | CHUNK_END};
+}
+
+#ifdef BLAKE3_USE_SSE2
+__m128i rotr128(__m128i value, int bits)
+{
+    return _mm_or_si128(_mm_srli_epi32(value, bits), _mm_slli_epi32(value, 32 - bits));
+}
+
+void g4(__m128i* s, unsigned a, unsigned b, unsigned c, unsigned d, __m128i mx, __m128i my)
+{
+    s[a] = _mm_add_epi32(_mm_add_epi32(s[a], s[b]), mx);
+    s[d] = rotr128(_mm_xor_si128(s[d], s[a]), 16);
+    s[c] = _mm_add_epi32(s[c], s[d]);
+    s[b] = rotr128(_mm_xor_si128(s[b], s[c]), 12);
+    s[a] = _mm_add_epi32(_mm_add_epi32(s[a], s[b]), my);
+    s[d] = rotr128(_mm_xor_si128(s[d], s[a]), 8);
+    s[c] = _mm_add_epi32(s[c], s[d]);
+    s[b] = rotr128(_mm_xor_si128(s[b], s[c]), 7);
+}
+
+/// Hash 4 complete chunks at once, one per SIMD lane
+void hash4Chunks(const uint8_t* data, uint64_t chunkCounter, ChainingValue* cvs)
+{
+    __m128i cv[8];
+    for(unsigned i = 0; i < 8; i++)
+        cv[i] = _mm_set1_epi32(static_cast<int>(IV[i]));
+    const auto counterWord = [chunkCounter](unsigned lane, unsigned shift) {
+        return static_cast<int>(static_cast<uint32_t>((chunkCounter + lane) >> shift));
+    };
+    const __m128i counterLow =
+      _mm_setr_epi32(counterWord(0, 0), counterWord(1, 0), counterWord(2, 0), counterWord(3, 0));
+    const __m128i counterHigh =
+      _mm_setr_epi32(counterWord(0, 32), counterWord(1, 32), counterWord(2, 32), counterWord(3, 32));
+
+    for(unsigned blockIdx = 0; blockIdx < blocksPerChunk; blockIdx++)
+    {
+        // Transpose: m[i] contains word i of the current block of all 4 chunks
+        __m128i m[16];
+        for(unsigned i = 0; i < 16; i++)
+        {
+            const uint8_t* word = data + blockIdx * Blake3::blockSize + i * 4;
+            m[i] = _mm_setr_epi32(static_cast<int>(loadLE(word)),
+                                  static_cast<int>(loadLE(word + Blake3::chunkSize)),
+                                  static_cast<int>(loadLE(word + 2 * Blake3::chunkSize)),
+                                  static_cast<int>(loadLE(word + 3 * Blake3::chunkSize)));
+        }
+        uint32_t flags = 0;
+        if(blockIdx == 0)
+            flags |= CHUNK_START;
+        if(blockIdx + 1 == blocksPerChunk)
+            flags |= CHUNK_END;
+        __m128i s[16] = {cv[0],
+                         cv[1],
+                         cv[2],
+                         cv[3],
+                         cv[4],
+                         cv[5],
+                         cv[6],
+                         cv[7],
+                         _mm_set1_epi32(static_cast<int>(IV[0])),
+                         _mm_set1_epi32(static_cast<int>(IV[1])),
+                         _mm_set1_epi32(static_cast<int>(IV[2])),
+                         _mm_set1_epi32(static_cast<int>(IV[3])),
+                         counterLow,
+                         counterHigh,
+                         _mm_set1_epi32(static_cast<int>(Blake3::blockSize)),
+                         _mm_set1_epi32(static_cast<int>(flags))};
+        for(unsigned round = 0; round < 7; round++)
+        {
+            g4(s, 0, 4, 8, 12, m[0], m[1]);
+            g4(s, 1, 5, 9, 13, m[2], m[3]);
+            g4(s, 2, 6, 10, 14, m[4], m[5]);
+            g4(s, 3, 7, 11, 15, m[6], m[7]);
+            g4(s, 0, 5, 10, 15, m[8], m[9]);
+            g4(s, 1, 6, 11, 12, m[10], m[11]);
+            g4(s, 2, 7, 8, 13, m[12], m[13]);
+            g4(s, 3, 4, 9, 14, m[14], m[15]);
+            __m128i permuted[16];
+            for(unsigned i = 0; i < 16; i++)
+                permuted[i] = m[msgPermutation[i]];
+            std::copy(std::begin(permuted), std::end(permuted), std::begin(m));
+        }
+        for(unsigned i = 0; i < 8; i++)
+            cv[i] = _mm_xor_si128(s[i], s[i + 8]);
+    }
+
+    for(unsigned i = 0; i < 8; i++)
+    {
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), cv[i]);
+        for(unsigned lane = 0; lane < 4; lane++)
+            cvs[lane][i] = lanes[lane];
+    }
+}
+#endif
+
+/// Get the chaining values of all complete chunks in the buffer
+void hashChunks(const uint8_t* data, size_t numChunks, uint64_t chunkCounter, ChainingValue* cvs)
+{
+#ifdef BLAKE3_USE_SSE2
+    for(; numChunks >= 4; numChunks -= 4)
+    {
+        hash4Chunks(data, chunkCounter, cvs);
+        data += 4 * Blake3::chunkSize;
+        chunkCounter += 4;
+        cvs += 4;
+    }
+#endif
+    for(; numChunks > 0; numChunks--)
+    {
+        *cvs++ = chunkOutput(data, Blake3::chunkSize, chunkCounter++).chainingValue();
+        data += Blake3::chunkSize;
+    }
+}
+
+/// Largest power of 2 number of chunks, which leaves at least one byte for the right subtree
+size_t leftSubtreeSize(size_t size)
+{
+    const size_t fullChunks = (size - 1) / Blake3::chunkSize;
+    size_t result = 1;
+    while(result * 2 <= fullChunks)
+        result *= 2;
+    return result * Blake3::chunkSize;
+}
+
+ChainingValue subtreeCv(const uint8_t* data, size_t size, uint64_t chunkCounter, Executor* executor);
+
+/// Chaining values of the left and right subtree of a tree of more than one chunk.
+/// Large subtrees are hashed as separate tasks of the executor
+void childCvs(const uint8_t* data, size_t size, uint64_t chunkCounter, Executor* executor, ChainingValue& left,
+              ChainingValue& right)
+{
+    const size_t leftSize = leftSubtreeSize(size);
+    const uint64_t rightCounter = chunkCounter + leftSize / Blake3::chunkSize;
+    if(executor && size > minTaskChunks * Blake3::chunkSize)
+    {
+        Executor::TaskGroup group(*executor);
+        group.run([&]() { left = subtreeCv(data, leftSize, chunkCounter, executor); }, Executor::Priority::High);
+        right = subtreeCv(data + leftSize, size - leftSize, rightCounter, executor);
+        group.wait();
+    } else
+    {
+        left = subtreeCv(data, leftSize, chunkCounter, nullptr);
+        right = subtreeCv(data + leftSize, size - leftSize, rightCounter, nullptr);
+    }
+}
+
+/// Chaining value of a (non-root) subtree
+ChainingValue subtreeCv(const uint8_t* data, size_t size, uint64_t chunkCounter, Executor* executor)
+{
+    // A complete leaf subtree: Hash all chunks at once and merge them pairwise
+    if(size == leafChunks * Blake3::chunkSize)
+    {
+        std::array<ChainingValue, leafChunks> cvs;
+        hashChunks(data, leafChunks, chunkCounter, cvs.data());
+        for(size_t numCvs = leafChunks; numCvs > 1; numCvs /= 2)
+        {
+            for(size_t i = 0; i < numCvs / 2; i++)
+                cvs[i] = parentOutput(cvs[2 * i], cvs[2 * i + 1]).chainingValue();
+        }
+        return cvs[0];
+    }
+    if(size <= Blake3::chunkSize)
+        return chunkOutput(data, size, chunkCounter).chainingValue();
+
+    ChainingValue left, right;
+    childCvs(data, size, chunkCounter, executor, left, right);
+    return parentOutput(left, right).chainingValue();
+}
+} // namespace
+
+Blake3::ChunkState::ChunkState(uint64_t chunkCounter)
+    : cv(IV), chunkCounter(chunkCounter), block(), blockLen(0), blocksCompressed(0)
+{}
+
+void Blake3::ChunkState::update(const uint8_t* data, size_t size)
+{
+    while(size > 0)
+    {
+        // Only compress a full block when more data follows, the last block is compressed by the output
+        if(blockLen == blockSize)
+        {
+            cv = toCv(compress(cv, loadBlock(block.data()), chunkCounter, blockSize,
+                               blocksCompressed == 0 ? CHUNK_START : 0));
+            blocksCompressed++;
+            blockLen = 0;
+            block.fill(0);
+        }
+        const size_t take = std::min(size, blockSize - blockLen);
+        std::copy_n(data, take, block.begin() + blockLen);
+        blockLen += static_cast<uint8_t>(take);
+        data += take;
+        size -= take;
+    }
+}
+
+Blake3::Blake3() : chunkState_(0) {}
+
+void Blake3::addChunkCv(ChainingValue cv, uint64_t totalChunks)
+{
+    // Merge completed subtrees, one for each trailing zero bit of the number of chunks
+    while((totalChunks & 1) == 0)
+    {
+        cv = parentOutput(cvStack_.back(), cv).chainingValue();
+        cvStack_.pop_back();
+        totalChunks >>= 1;
+    }
+    cvStack_.push_back(cv);
+}
+
+void Blake3::update(const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    while(size > 0)
+    {
+        if(chunkState_.size() == chunkSize)
+        {
+            const uint64_t totalChunks = chunkState_.chunkCounter + 1;
+            addChunkCv(chunkStateOutput(chunkState_).chainingValue(), totalChunks);
+            chunkState_ = ChunkState(totalChunks);
+        }
+        const size_t take = std::min(size, chunkSize - chunkState_.size());
+        chunkState_.update(bytes, take);
+        bytes += take;
+        size -= take;
+    }
+}
+
+std::string Blake3::toString() const
+{
+    Output output = chunkStateOutput(chunkState_);
+    for(auto it = cvStack_.rbegin(); it != cvStack_.rend(); ++it)
+        output = parentOutput(*it, output.chainingValue());
+    return output.rootDigest();
+}
+
+std::string Blake3::hashBuffer(const void* data, size_t size, Executor* executor)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    if(size <= chunkSize)
+        return chunkOutput(bytes, size, 0).rootDigest();
+    ChainingValue left, right;
+    childCvs(bytes, size, 0, executor, left, right);
+    return parentOutput(left, right).rootDigest();
+}
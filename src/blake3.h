@@ -0,0 +1,53 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Executor;
+
+/// Implementation of the BLAKE3 hash function (unkeyed mode with 32 byte output)
+class Blake3
+{
+public:
+    static constexpr size_t digestSize = 32;
+    static constexpr size_t chunkSize = 1024;
+    static constexpr size_t blockSize = 64;
+
+    Blake3();
+    /// Add data to the hash
+    void update(const void* data, size_t size);
+    /// Get the hex digest of all data added so far
+    std::string toString() const;
+
+    /// Hash a complete buffer. Subtrees are hashed in parallel by the executor if given
+    /// and chunks are hashed with SIMD where available
+    static std::string hashBuffer(const void* data, size_t size, Executor* executor = nullptr);
+
+    using ChainingValue = std::array<uint32_t, 8>;
+
+private:
+    struct ChunkState
+    {
+        ChainingValue cv;
+        uint64_t chunkCounter;
+        std::array<uint8_t, blockSize> block;
+        uint8_t blockLen;
+        uint8_t blocksCompressed;
+
+        explicit ChunkState(uint64_t chunkCounter);
+        size_t size() const { return blockSize * blocksCompressed + blockLen; }
+        void update(const uint8_t* data, size_t size);
+    };
+
+    ChunkState chunkState_;
+    std::vector<ChainingValue> cvStack_;
+
+    void addChunkCv(ChainingValue cv, uint64_t totalChunks);
+};
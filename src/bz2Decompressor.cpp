@@ -0,0 +1,105 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "bz2Decompressor.h"
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+Bz2Decompressor::Bz2Decompressor() : stream_() {}
+
+Bz2Decompressor::~Bz2Decompressor()
+{
+    end();
+    for(const Block& block : blocks_)
+        std::free(block.ptr);
+}
+
+bool Bz2Decompressor::begin()
+{
+    end();
+    stream_ = bz_stream();
+    stream_.bzalloc = allocate;
+    stream_.bzfree = deallocate;
+    stream_.opaque = this;
+    active_ = BZ2_bzDecompressInit(&stream_, 0, 0) == BZ_OK;
+    return active_;
+}
+
+void Bz2Decompressor::end()
+{
+    if(active_)
+        BZ2_bzDecompressEnd(&stream_);
+    active_ = false;
+}
+
+int Bz2Decompressor::decompress(const char*& input, size_t& inputSize, char*& output, size_t& outputSize)
+{
+    if(!active_)
+        return BZ_SEQUENCE_ERROR;
+    constexpr size_t maxSize = std::numeric_limits<unsigned>::max();
+    // bzip2 API is not const-correct
+    stream_.next_in = const_cast<char*>(input);
+    stream_.avail_in = static_cast<unsigned>(std::min(inputSize, maxSize));
+    stream_.next_out = output;
+    stream_.avail_out = static_cast<unsigned>(std::min(outputSize, maxSize));
+    const unsigned oldAvailIn = stream_.avail_in, oldAvailOut = stream_.avail_out;
+    const int result = BZ2_bzDecompress(&stream_);
+    input += oldAvailIn - stream_.avail_in;
+    inputSize -= oldAvailIn - stream_.avail_in;
+    output += oldAvailOut - stream_.avail_out;
+    outputSize -= oldAvailOut - stream_.avail_out;
+    if(result == BZ_STREAM_END)
+        end();
+    return result;
+}
+
+bool Bz2Decompressor::decompressBuffer(const char* input, size_t inputSize, char* output, size_t outputSize)
+{
+    if(!begin())
+        return false;
+    int result = BZ_OK;
+    while(result == BZ_OK)
+    {
+        const size_t oldInputSize = inputSize, oldOutputSize = outputSize;
+        result = decompress(input, inputSize, output, outputSize);
+        // No progress: Input is truncated or output too small
+        if(result == BZ_OK && inputSize == oldInputSize && outputSize == oldOutputSize)
+            break;
+    }
+    end();
+    return result == BZ_STREAM_END && outputSize == 0;
+}
+
+void* Bz2Decompressor::allocate(void* opaque, int count, int size)
+{
+    auto& blocks = static_cast<Bz2Decompressor*>(opaque)->blocks_;
+    const size_t numBytes = static_cast<size_t>(count) * static_cast<size_t>(size);
+    for(Block& block : blocks)
+    {
+        if(!block.inUse && block.size == numBytes)
+        {
+            block.inUse = true;
+            return block.ptr;
+        }
+    }
+    void* ptr = std::malloc(numBytes);
+    if(ptr)
+        blocks.push_back({ptr, numBytes, true});
+    return ptr;
+}
+
+void Bz2Decompressor::deallocate(void* opaque, void* ptr)
+{
+    auto& blocks = static_cast<Bz2Decompressor*>(opaque)->blocks_;
+    const auto it = std::find_if(blocks.begin(), blocks.end(), [ptr](const Block& block) { return block.ptr == ptr; });
+    if(it != blocks.end())
+        it->inUse = false;
+}
+
+ObjectPool<Bz2Decompressor>& getBz2DecompressorPool()
+{
+    static ObjectPool<Bz2Decompressor> pool;
+    return pool;
+}
@@ -0,0 +1,48 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "objectPool.h"
+#include <bzlib.h>
+#include <cstddef>
+#include <vector>
+
+/// bzip2 decompressor which can be reused for multiple streams.
+/// bzip2 can't reset a stream, so each stream is initialized anew, but the large tables allocated by bzip2 are kept
+/// and handed out again to the next stream, which needs the same sizes for the same block size.
+class Bz2Decompressor
+{
+public:
+    Bz2Decompressor();
+    ~Bz2Decompressor();
+    Bz2Decompressor(const Bz2Decompressor&) = delete;
+    Bz2Decompressor& operator=(const Bz2Decompressor&) = delete;
+
+    /// Start decompressing a new stream, ending a previous one
+    bool begin();
+    /// Decompress from the input to the output, advancing both. Return the bzip2 status code (BZ_STREAM_END when done)
+    int decompress(const char*& input, size_t& inputSize, char*& output, size_t& outputSize);
+    /// Decompress a complete stream into a buffer of exactly the decompressed size
+    bool decompressBuffer(const char* input, size_t inputSize, char* output, size_t outputSize);
+
+private:
+    bz_stream stream_;
+    bool active_ = false;
+    struct Block
+    {
+        void* ptr;
+        size_t size;
+        /// Used by the current stream
+        bool inUse;
+    };
+    std::vector<Block> blocks_;
+
+    void end();
+    static void* allocate(void* opaque, int count, int size);
+    static void deallocate(void* opaque, void* ptr);
+};
+
+/// Decompressors shared by all stages of the process
+ObjectPool<Bz2Decompressor>& getBz2DecompressorPool();
@@ -0,0 +1,166 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "changeWatcher.h"
+#include "s25util/warningSuppression.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+#ifdef __linux__
+#    include <poll.h>
+#    include <sys/inotify.h>
+#    include <unistd.h>
+#endif
+
+namespace {
+volatile std::sig_atomic_t interrupted = 0;
+
+void onInterrupt(int)
+{
+    interrupted = 1;
+}
+
+std::pair<std::string, std::string> splitPath(const std::string& path)
+{
+    const auto slashPos = path.rfind('/');
+    if(slashPos == std::string::npos)
+        return {".", path};
+    return {path.substr(0, slashPos), path.substr(slashPos + 1)};
+}
+} // namespace
+
+ChangeWatcher::ChangeWatcher(std::vector<std::string> filePaths) : filePaths_(std::move(filePaths))
+{
+    if(!isSupported())
+        throw std::runtime_error("Watching for changes is not supported on this platform");
+    for(size_t i = 0; i < filePaths_.size(); i++)
+    {
+        auto dirAndName = splitPath(filePaths_[i]);
+        dirFiles_[dirAndName.first][dirAndName.second] = i;
+    }
+#ifdef __linux__
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd_ < 0)
+        throw std::runtime_error("Failed to initialize inotify");
+#endif
+    std::signal(SIGINT, onInterrupt);
+    std::signal(SIGTERM, onInterrupt);
+    refresh();
+}
+
+ChangeWatcher::~ChangeWatcher()
+{
+#ifdef __linux__
+    if(fd_ >= 0)
+        close(fd_);
+#endif
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+}
+
+bool ChangeWatcher::isSupported()
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ChangeWatcher::refresh()
+{
+#ifdef __linux__
+    watchedDirs_.clear();
+    for(const auto& it : dirFiles_)
+    {
+        constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                                  | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+        // Adding an existing watch returns the same descriptor, so this can be called repeatedly
+        const int wd = inotify_add_watch(fd_, it.first.c_str(), mask);
+        if(wd >= 0)
+            watchedDirs_[wd] = it.first;
+    }
+#endif
+}
+
+void ChangeWatcher::readEvents(std::vector<bool>& changed)
+{
+#ifdef __linux__
+    alignas(inotify_event) std::array<char, 4096> buffer;
+    ssize_t len;
+    while((len = read(fd_, buffer.data(), buffer.size())) > 0)
+    {
+        for(const char* ptr = buffer.data(); ptr < buffer.data() + len;)
+        {
+            const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                // Events of any directory were lost (wd is -1) -> Consider all files changed
+                std::fill(changed.begin(), changed.end(), true);
+                continue;
+            }
+            const auto itDir = watchedDirs_.find(event->wd);
+            if(itDir == watchedDirs_.end())
+                continue;
+            const auto& files = dirFiles_[itDir->second];
+            if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            {
+                // Directory is gone -> Consider all its files changed
+                for(const auto& file : files)
+                    changed[file.second] = true;
+            } else if(event->len > 0)
+            {
+                const auto itFile = files.find(event->name);
+                if(itFile != files.end())
+                    changed[itFile->second] = true;
+            }
+        }
+    }
+#else
+    RTTR_UNUSED(changed);
+#endif
+}
+
+bool ChangeWatcher::isInterrupted()
+{
+    return interrupted != 0;
+}
+
+std::vector<size_t> ChangeWatcher::waitForChanges(std::chrono::milliseconds settleTime,
+                                                  std::chrono::milliseconds maxWait)
+{
+    std::vector<bool> changed(filePaths_.size());
+#ifdef __linux__
+    bool anyChanged = false;
+    while(!interrupted)
+    {
+        pollfd pfd{fd_, POLLIN, 0};
+        // Wait up to maxWait for the first change, then until no further changes come in
+        const int ret = poll(&pfd, 1, static_cast<int>(anyChanged ? settleTime.count() : maxWait.count()));
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            throw std::runtime_error("Failed to wait for file changes");
+        }
+        if(ret == 0)
+            break;
+        readEvents(changed);
+        anyChanged = std::find(changed.begin(), changed.end(), true) != changed.end();
+    }
+    if(interrupted)
+        return {};
+#endif
+    std::vector<size_t> result;
+    for(size_t i = 0; i < changed.size(); i++)
+    {
+        if(changed[i])
+            result.push_back(i);
+    }
+    return result;
+}
@@ -0,0 +1,46 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Watches the directories of a list of files for modifications of those files.
+/// Currently only implemented for Linux (inotify)
+class ChangeWatcher
+{
+public:
+    explicit ChangeWatcher(std::vector<std::string> filePaths);
+    ~ChangeWatcher();
+    ChangeWatcher(const ChangeWatcher&) = delete;
+    ChangeWatcher& operator=(const ChangeWatcher&) = delete;
+
+    static bool isSupported();
+
+    /// True after SIGINT/SIGTERM was received while watching
+    static bool isInterrupted();
+
+    /// Wait until at least one of the files changed and no further change happened for settleTime.
+    /// Return the indices of the changed files or an empty list when interrupted by SIGINT/SIGTERM or if nothing
+    /// changed within maxWait. A negative maxWait waits indefinitely for the first change
+    std::vector<size_t> waitForChanges(std::chrono::milliseconds settleTime,
+                                       std::chrono::milliseconds maxWait = std::chrono::milliseconds(-1));
+    /// (Re-)Add watches for all directories, required after directories were removed and recreated
+    void refresh();
+
+private:
+    std::vector<std::string> filePaths_;
+    /// Directory -> (Filename -> Index)
+    std::map<std::string, std::unordered_map<std::string, size_t>> dirFiles_;
+    /// Watch descriptor -> Directory
+    std::unordered_map<int, std::string> watchedDirs_;
+    int fd_ = -1;
+
+    /// Read all pending events and add the indices of changed files
+    void readEvents(std::vector<bool>& changed);
+};
@@ -0,0 +1,135 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "chunkHashes.h"
+#include "executor.h"
+#include "md5sum.h"
+#include <boost/nowide/cstdio.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+namespace bnw = boost::nowide;
+
+namespace {
+bool seekTo(FILE* fp, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(fp, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(fp, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+} // namespace
+
+uint32_t ChunkList::getChunkLength(size_t idx) const
+{
+    return static_cast<uint32_t>(std::min<uint64_t>(chunkSize, fileSize - getChunkOffset(idx)));
+}
+
+std::unordered_map<std::string, ChunkList> parseChunkList(const std::string& chunkListContents)
+{
+    std::unordered_map<std::string, ChunkList> result;
+    std::stringstream clstream(chunkListContents);
+
+    std::string line;
+    while(getline(clstream, line))
+    {
+        if(line.empty())
+            break;
+
+        std::stringstream header(line);
+        ChunkList chunks;
+        std::string path;
+        if(!(header >> chunks.fileSize >> chunks.chunkSize >> chunks.rootHash) || chunks.chunkSize == 0
+           || line.find("  ") == std::string::npos)
+            throw std::runtime_error("Invalid line in chunk list: " + line);
+        path = line.substr(line.find("  ") + 2);
+
+        const uint64_t numChunks = (chunks.fileSize + chunks.chunkSize - 1) / chunks.chunkSize;
+        chunks.chunkHashes.reserve(static_cast<size_t>(numChunks));
+        while(chunks.chunkHashes.size() < numChunks && getline(clstream, line))
+        {
+            if(line.size() != 32)
+                throw std::runtime_error("Invalid chunk hash for " + path + ": " + line);
+            chunks.chunkHashes.push_back(line);
+        }
+        if(chunks.chunkHashes.size() != numChunks || calcRootHash(chunks.chunkHashes) != chunks.rootHash)
+            throw std::runtime_error("Chunk list of " + path + " is corrupt");
+
+        result[path] = std::move(chunks);
+    }
+    return result;
+}
+
+std::string calcRootHash(const std::vector<std::string>& chunkHashes)
+{
+    std::string concatenated;
+    concatenated.reserve(chunkHashes.size() * 32);
+    for(const std::string& chunkHash : chunkHashes)
+        concatenated += chunkHash;
+    return md5string(concatenated);
+}
+
+std::vector<size_t> findCorruptChunks(const std::string& filePath, const ChunkList& chunks, Executor& executor)
+{
+    std::vector<size_t> result;
+    std::mutex resultMutex;
+    std::atomic<size_t> nextChunk(0);
+    std::atomic<bool> readError(false);
+
+    // Each task reads through its own file handle and takes the next unprocessed chunk
+    const auto hashChunks = [&]() {
+        FILE* fp = bnw::fopen(filePath.c_str(), "rb");
+        if(!fp)
+        {
+            readError = true;
+            return;
+        }
+        size_t idx;
+        while((idx = nextChunk++) < chunks.chunkHashes.size())
+        {
+            std::string digest;
+            if(!seekTo(fp, chunks.getChunkOffset(idx)) || md5range(fp, chunks.getChunkLength(idx), digest) != 0)
+            {
+                readError = true;
+                break;
+            }
+            if(digest != chunks.chunkHashes[idx])
+            {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                result.push_back(idx);
+            }
+        }
+        fclose(fp);
+    };
+
+    const size_t numTasks = std::min<size_t>(executor.getNumThreads(), chunks.chunkHashes.size());
+    Executor::TaskGroup group(executor);
+    for(size_t i = 0; i < numTasks; i++)
+        group.run(hashChunks, Executor::Priority::High);
+    group.wait();
+
+    // An unreadable file is outdated as a whole, like with the hash of the whole file
+    if(readError)
+    {
+        result.resize(chunks.chunkHashes.size());
+        std::iota(result.begin(), result.end(), 0);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool writeChunk(const std::string& filePath, const ChunkList& chunks, size_t idx, const std::string& data)
+{
+    if(data.size() != chunks.getChunkLength(idx))
+        return false;
+    bnw::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+    return file.seekp(static_cast<std::streamoff>(chunks.getChunkOffset(idx)))
+           && file.write(data.data(), static_cast<std::streamsize>(data.size())) && file.flush();
+}
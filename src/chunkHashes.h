@@ -0,0 +1,35 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Executor;
+
+/// Hashes of the fixed-size chunks of a file
+struct ChunkList
+{
+    uint64_t fileSize;
+    uint32_t chunkSize;
+    /// md5 of the concatenated chunk hashes
+    std::string rootHash;
+    std::vector<std::string> chunkHashes;
+
+    uint64_t getChunkOffset(size_t idx) const { return static_cast<uint64_t>(idx) * chunkSize; }
+    uint32_t getChunkLength(size_t idx) const;
+};
+
+/// Parse the optional chunk list of the manifest.
+/// Format: "<fileSize> <chunkSize> <rootHash>  <path>" followed by one line with the md5 of each chunk
+std::unordered_map<std::string, ChunkList> parseChunkList(const std::string& chunkListContents);
+std::string calcRootHash(const std::vector<std::string>& chunkHashes);
+/// Hash the chunks of the file in parallel using the executor and return the indices of the chunks not matching.
+/// All chunks are corrupt if the file can't be read
+std::vector<size_t> findCorruptChunks(const std::string& filePath, const ChunkList& chunks, Executor& executor);
+/// Overwrite a chunk of the file with the given data
+bool writeChunk(const std::string& filePath, const ChunkList& chunks, size_t idx, const std::string& data);
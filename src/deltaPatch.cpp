@@ -0,0 +1,351 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "deltaPatch.h"
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/nowide/cstdio.hpp>
+#include <algorithm>
+#include <array>
+#include <bzlib.h>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace bfs = boost::filesystem;
+namespace bip = boost::interprocess;
+namespace bnw = boost::nowide;
+
+namespace delta {
+namespace {
+constexpr std::array<char, 4> magic = {'S', '2', '5', 'D'};
+constexpr uint32_t formatVersion = 1;
+constexpr size_t headerSize = 16;
+enum Operation : char
+{
+    opCopy = 0,
+    opInsert = 1,
+    opEnd = 2
+};
+constexpr size_t copySize = 17;
+constexpr size_t insertSize = 9;
+/// Blocks of the old file which are searched for in the new one, about the square root of the file size
+constexpr size_t minBlockSize = 512;
+constexpr size_t maxBlockSize = 64 * 1024;
+
+void putU64(std::string& out, uint64_t value)
+{
+    for(unsigned i = 0; i < 8; i++)
+        out.push_back(static_cast<char>(value >> (8 * i)));
+}
+
+uint64_t getU64(const char* data)
+{
+    uint64_t value = 0;
+    for(unsigned i = 0; i < 8; i++)
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    return value;
+}
+
+/// Read-only view of a whole file mapped into memory
+class MappedFile
+{
+public:
+    explicit MappedFile(const bfs::path& filePath) : size_(static_cast<size_t>(bfs::file_size(filePath)))
+    {
+        // Empty files can't be mapped
+        if(size_ > 0)
+        {
+            bip::file_mapping file(filePath.string().c_str(), bip::read_only);
+            region_ = bip::mapped_region(file, bip::read_only);
+        }
+    }
+    const unsigned char* data() const { return static_cast<const unsigned char*>(region_.get_address()); }
+    size_t size() const { return size_; }
+
+private:
+    size_t size_;
+    bip::mapped_region region_;
+};
+
+/// Weak checksum of rsync, which can be rolled over the data one byte at a time
+class RollingChecksum
+{
+public:
+    void init(const unsigned char* data, size_t size)
+    {
+        a_ = b_ = 0;
+        for(size_t i = 0; i < size; i++)
+        {
+            a_ += data[i];
+            b_ += static_cast<uint32_t>(size - i) * data[i];
+        }
+    }
+    /// Move the window of size bytes by one byte
+    void roll(unsigned char removed, unsigned char added, size_t size)
+    {
+        a_ += added - removed;
+        b_ += a_ - static_cast<uint32_t>(size) * removed;
+    }
+    uint32_t value() const { return (a_ & 0xFFFF) | (b_ << 16); }
+
+private:
+    uint32_t a_ = 0, b_ = 0;
+};
+
+/// Writes the operations of a patch bzip2 compressed to a file
+class PatchWriter
+{
+public:
+    explicit PatchWriter(const bfs::path& patchPath) : file_(bnw::fopen(patchPath.string().c_str(), "wb"))
+    {
+        int error = BZ_OK;
+        if(file_)
+            bzFile_ = BZ2_bzWriteOpen(&error, file_, 9, 0, 0);
+        if(!bzFile_)
+            throw std::runtime_error("Failed to open " + patchPath.string());
+    }
+    ~PatchWriter()
+    {
+        int error;
+        if(bzFile_)
+            BZ2_bzWriteClose(&error, bzFile_, 1, nullptr, nullptr);
+        if(file_)
+            fclose(file_);
+    }
+    PatchWriter(const PatchWriter&) = delete;
+    PatchWriter& operator=(const PatchWriter&) = delete;
+
+    void writeHeader(uint64_t newSize)
+    {
+        std::string header(magic.begin(), magic.end());
+        for(unsigned i = 0; i < 4; i++)
+            header.push_back(static_cast<char>(formatVersion >> (8 * i)));
+        putU64(header, newSize);
+        write(header.data(), header.size());
+    }
+    void copy(uint64_t offset, uint64_t length)
+    {
+        std::string operation(1, opCopy);
+        putU64(operation, offset);
+        putU64(operation, length);
+        write(operation.data(), operation.size());
+    }
+    void insert(const unsigned char* data, size_t size)
+    {
+        if(size == 0)
+            return;
+        std::string operation(1, opInsert);
+        putU64(operation, size);
+        write(operation.data(), operation.size());
+        write(reinterpret_cast<const char*>(data), size);
+    }
+    /// End the patch and return the compressed size
+    uint64_t finish()
+    {
+        const char operation = opEnd;
+        write(&operation, 1);
+        int error;
+        unsigned sizeLow, sizeHigh;
+        BZ2_bzWriteClose64(&error, bzFile_, 0, nullptr, nullptr, &sizeLow, &sizeHigh);
+        bzFile_ = nullptr;
+        const bool closed = fclose(file_) == 0;
+        file_ = nullptr;
+        if(error != BZ_OK || !closed)
+            throw std::runtime_error("Failed to write patch");
+        return (static_cast<uint64_t>(sizeHigh) << 32) | sizeLow;
+    }
+
+private:
+    FILE* file_;
+    BZFILE* bzFile_ = nullptr;
+
+    void write(const char* data, size_t size)
+    {
+        while(size > 0)
+        {
+            const int curSize = static_cast<int>(std::min<size_t>(size, 1 << 30));
+            int error;
+            BZ2_bzWrite(&error, bzFile_, const_cast<char*>(data), curSize);
+            if(error != BZ_OK)
+                throw std::runtime_error("Failed to write patch");
+            data += curSize;
+            size -= curSize;
+        }
+    }
+};
+} // namespace
+
+Index parseIndex(const std::string& indexContents)
+{
+    Index result;
+    std::stringstream istream(indexContents);
+
+    std::string line;
+    while(getline(istream, line))
+    {
+        if(line.empty())
+            break;
+        std::stringstream entryLine(line);
+        std::string oldDigest, newDigest;
+        IndexEntry entry;
+        if(!(entryLine >> oldDigest >> newDigest >> entry.size) || line.find("  ") == std::string::npos)
+            throw std::runtime_error("Invalid line in delta index: " + line);
+        entry.path = line.substr(line.find("  ") + 2);
+        result[std::make_pair(std::move(oldDigest), std::move(newDigest))] = std::move(entry);
+    }
+    return result;
+}
+
+std::string formatIndex(const Index& index)
+{
+    std::stringstream result;
+    for(const auto& entry : index)
+        result << entry.first.first << " " << entry.first.second << " " << entry.second.size << "  "
+               << entry.second.path << "\n";
+    return result.str();
+}
+
+uint64_t createPatch(const bfs::path& oldPath, const bfs::path& newPath, const bfs::path& patchPath)
+{
+    const MappedFile oldFile(oldPath);
+    const MappedFile newFile(newPath);
+    const unsigned char* oldData = oldFile.data();
+    const unsigned char* newData = newFile.data();
+    const size_t oldSize = oldFile.size();
+    const size_t newSize = newFile.size();
+    const size_t blockSize =
+      std::min(maxBlockSize, std::max(minBlockSize, static_cast<size_t>(std::sqrt(static_cast<double>(oldSize)))));
+
+    // Offset of the first block of the old file with each checksum. Blocks are verified by comparing their data
+    std::unordered_map<uint32_t, size_t> blockOffsets;
+    blockOffsets.reserve(oldSize / blockSize);
+    RollingChecksum checksum;
+    for(size_t offset = 0; offset + blockSize <= oldSize; offset += blockSize)
+    {
+        checksum.init(oldData + offset, blockSize);
+        blockOffsets.emplace(checksum.value(), offset);
+    }
+
+    PatchWriter writer(patchPath);
+    writer.writeHeader(newSize);
+    // Data since literalStart has no match in the old file
+    size_t literalStart = 0;
+    bool isChecksumValid = false;
+    for(size_t pos = 0; pos + blockSize <= newSize;)
+    {
+        if(!isChecksumValid)
+        {
+            checksum.init(newData + pos, blockSize);
+            isChecksumValid = true;
+        }
+        const auto itBlock = blockOffsets.find(checksum.value());
+        if(itBlock == blockOffsets.end() || std::memcmp(oldData + itBlock->second, newData + pos, blockSize) != 0)
+        {
+            if(pos + blockSize < newSize)
+                checksum.roll(newData[pos], newData[pos + blockSize], blockSize);
+            pos++;
+            continue;
+        }
+        // Extend the match in both directions, as the blocks of the old file are aligned
+        size_t oldStart = itBlock->second;
+        size_t newStart = pos;
+        while(newStart > literalStart && oldStart > 0 && oldData[oldStart - 1] == newData[newStart - 1])
+        {
+            oldStart--;
+            newStart--;
+        }
+        size_t oldEnd = itBlock->second + blockSize;
+        size_t newEnd = pos + blockSize;
+        while(newEnd < newSize && oldEnd < oldSize && oldData[oldEnd] == newData[newEnd])
+        {
+            oldEnd++;
+            newEnd++;
+        }
+        writer.insert(newData + literalStart, newStart - literalStart);
+        writer.copy(oldStart, newEnd - newStart);
+        pos = literalStart = newEnd;
+        isChecksumValid = false;
+    }
+    writer.insert(newData + literalStart, newSize - literalStart);
+    return writer.finish();
+}
+
+Decoder::Decoder(const bfs::path& oldPath) : oldFile_(oldPath, std::ios::binary)
+{
+    boost::system::error_code ec;
+    oldSize_ = bfs::file_size(oldPath, ec);
+    if(!oldFile_ || ec)
+        state_ = State::Failed;
+}
+
+bool Decoder::isFinished() const
+{
+    return state_ == State::End && written_ == newSize_;
+}
+
+size_t Decoder::getRequiredSize() const
+{
+    if(state_ == State::Header)
+        return headerSize;
+    // The size of an operation depends on its type in the first byte
+    if(pending_.empty())
+        return 1;
+    return pending_[0] == opCopy ? copySize : pending_[0] == opInsert ? insertSize : 1;
+}
+
+bool Decoder::processPending()
+{
+    const std::string pending = std::move(pending_);
+    pending_.clear();
+    if(state_ == State::Header)
+    {
+        uint32_t version = 0;
+        for(unsigned i = 0; i < 4; i++)
+            version |= static_cast<uint32_t>(static_cast<unsigned char>(pending[4 + i])) << (8 * i);
+        if(!std::equal(magic.begin(), magic.end(), pending.begin()) || version != formatVersion)
+            return false;
+        newSize_ = getU64(&pending[8]);
+        state_ = State::Operation;
+        return true;
+    }
+    switch(pending[0])
+    {
+        case opCopy: return prepareCopy(getU64(&pending[1]), getU64(&pending[9]));
+        case opInsert:
+            insertRemaining_ = getU64(&pending[1]);
+            if(insertRemaining_ > 0)
+                state_ = State::Insert;
+            return true;
+        case opEnd: state_ = State::End; return true;
+    }
+    return false;
+}
+
+bool Decoder::prepareCopy(uint64_t offset, uint64_t length)
+{
+    if(offset > oldSize_ || length > oldSize_ - offset || length > newSize_ - written_)
+        return false;
+    copyBuffer_.resize(64 * 1024);
+    oldFile_.clear();
+    if(!oldFile_.seekg(static_cast<std::streamoff>(offset)))
+        return false;
+    copyRemaining_ = length;
+    return true;
+}
+
+size_t Decoder::readCopyPiece()
+{
+    const size_t curSize = static_cast<size_t>(std::min<uint64_t>(copyRemaining_, copyBuffer_.size()));
+    if(!oldFile_.read(copyBuffer_.data(), static_cast<std::streamsize>(curSize)))
+        return 0;
+    written_ += curSize;
+    copyRemaining_ -= curSize;
+    return curSize;
+}
+
+} // namespace delta
@@ -0,0 +1,136 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Binary patches turning an old version of a file into a new one.
+/// A patch is a bzip2 compressed stream of a header ("S25D", u32 version, u64 new size) followed by operations, each
+/// starting with a type byte: Copy (u64 offset, u64 length) copies a range of the old file, Insert (u64 length and
+/// the data) adds new data and End terminates the patch. All integers are little endian
+namespace delta {
+
+/// Available patch of the file with oldDigest to the version with newDigest
+struct IndexEntry
+{
+    /// Path of the patch relative to the http base
+    std::string path;
+    /// Size of the patch
+    uint64_t size;
+};
+/// Patches by old and new digest
+using Index = std::map<std::pair<std::string, std::string>, IndexEntry>;
+
+/// Parse the optional delta index of the manifest. Format: "<oldDigest> <newDigest> <size>  <path>"
+Index parseIndex(const std::string& indexContents);
+/// Format the index as parsed by parseIndex
+std::string formatIndex(const Index& index);
+
+/// Create a patch from oldPath to newPath at patchPath and return its size.
+/// Both files are mapped into memory, so only a checksum per block of the old file is kept on the heap
+uint64_t createPatch(const boost::filesystem::path& oldPath, const boost::filesystem::path& newPath,
+                     const boost::filesystem::path& patchPath);
+
+/// Applies the uncompressed operations of a patch, which may arrive in arbitrary pieces
+class Decoder
+{
+public:
+    explicit Decoder(const boost::filesystem::path& oldPath);
+
+    /// Process a piece of the patch, passing the new contents to output.write(data, size), which returns false to
+    /// abort. The output is usually the next stage of a transfer sink. Return false if the patch is invalid or the
+    /// output failed
+    template<class T_Output>
+    bool write(const char* data, size_t size, T_Output& output);
+    /// Check that the patch was complete and produced the announced size
+    bool isFinished() const;
+
+private:
+    enum class State
+    {
+        Header,
+        Operation,
+        Insert,
+        End,
+        Failed
+    };
+
+    boost::nowide::ifstream oldFile_;
+    uint64_t oldSize_ = 0;
+    State state_ = State::Header;
+    /// Bytes of the header or operation received so far
+    std::string pending_;
+    uint64_t newSize_ = 0;
+    uint64_t written_ = 0;
+    uint64_t insertRemaining_ = 0;
+    /// Bytes of the old file still to copy by the current operation
+    uint64_t copyRemaining_ = 0;
+    std::vector<char> copyBuffer_;
+
+    /// Number of bytes of the header or current operation
+    size_t getRequiredSize() const;
+    /// Handle the complete header or operation. A copy is only prepared and done by copyPending
+    bool processPending();
+    bool prepareCopy(uint64_t offset, uint64_t length);
+    /// Read the next piece of the range to copy into copyBuffer_ and return its size or 0 on error
+    size_t readCopyPiece();
+    template<class T_Output>
+    bool copyPending(T_Output& output);
+};
+
+template<class T_Output>
+bool Decoder::write(const char* data, size_t size, T_Output& output)
+{
+    while(size > 0 && state_ != State::Failed)
+    {
+        if(state_ == State::Insert)
+        {
+            const size_t curSize = static_cast<size_t>(std::min<uint64_t>(size, insertRemaining_));
+            written_ += curSize;
+            if(written_ > newSize_ || !output.write(data, curSize))
+                state_ = State::Failed;
+            insertRemaining_ -= curSize;
+            if(insertRemaining_ == 0 && state_ != State::Failed)
+                state_ = State::Operation;
+            data += curSize;
+            size -= curSize;
+            continue;
+        }
+        // Nothing may follow the end
+        if(state_ == State::End)
+        {
+            state_ = State::Failed;
+            break;
+        }
+        const size_t curSize = std::min(size, getRequiredSize() - pending_.size());
+        pending_.append(data, curSize);
+        data += curSize;
+        size -= curSize;
+        if(pending_.size() == getRequiredSize() && (!processPending() || !copyPending(output)))
+            state_ = State::Failed;
+    }
+    return state_ != State::Failed;
+}
+
+template<class T_Output>
+bool Decoder::copyPending(T_Output& output)
+{
+    while(copyRemaining_ > 0)
+    {
+        const size_t curSize = readCopyPiece();
+        if(curSize == 0 || !output.write(copyBuffer_.data(), curSize))
+            return false;
+    }
+    return true;
+}
+
+} // namespace delta
@@ -0,0 +1,164 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "executor.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+/// Executor and queue index of the current worker thread
+thread_local const Executor* currentExecutor = nullptr;
+thread_local size_t currentQueue = 0;
+
+unsigned executorThreads = 0;
+} // namespace
+
+Executor::TaskGroup::~TaskGroup()
+{
+    try
+    {
+        wait();
+    } catch(...) //-V565
+    {}
+}
+
+void Executor::TaskGroup::run(std::function<void()> task, Priority priority)
+{
+    pending_++;
+    executor_.submit(
+      [this, &executor = executor_, task = std::move(task)]() {
+          try
+          {
+              task();
+          } catch(...)
+          {
+              std::lock_guard<std::mutex> lock(errorMutex_);
+              if(!error_)
+                  error_ = std::current_exception();
+          }
+          bool finished;
+          {
+              // The group may be destroyed as soon as the waiting thread sees the last task finish
+              std::lock_guard<std::mutex> lock(executor.wakeMutex_);
+              finished = --pending_ == 0;
+          }
+          if(finished)
+              executor.groupWake_.notify_all();
+      },
+      priority);
+}
+
+void Executor::TaskGroup::wait()
+{
+    while(pending_ > 0)
+    {
+        if(executor_.runOne(Priority::High))
+            continue;
+        // Tasks of this group are running elsewhere
+        std::unique_lock<std::mutex> lock(executor_.wakeMutex_);
+        executor_.groupWake_.wait(lock, [this]() {
+            return pending_ == 0 || executor_.numQueued_[static_cast<size_t>(Priority::High)] > 0;
+        });
+    }
+    std::lock_guard<std::mutex> lock(errorMutex_);
+    if(error_)
+        std::rethrow_exception(std::exchange(error_, nullptr));
+}
+
+Executor::Executor(unsigned numThreads)
+{
+    // The thread waiting for the tasks helps running them
+    const unsigned numWorkers = std::max(1u, numThreads) - (numThreads > 1 ? 1 : 0);
+    for(unsigned i = 0; i < numWorkers; i++)
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    for(unsigned i = 0; i < numWorkers; i++)
+        workers_.emplace_back([this, i]() { workerLoop(i); });
+}
+
+Executor::~Executor()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for(auto& worker : workers_)
+        worker.join();
+}
+
+void Executor::submit(std::function<void()> task, Priority priority)
+{
+    // Workers push to their own queue, so nested tasks stay local unless stolen
+    const size_t queueIdx = currentExecutor == this ? currentQueue : nextQueue_++ % queues_.size();
+    {
+        WorkerQueue& queue = *queues_[queueIdx];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks[static_cast<size_t>(priority)].push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        numQueued_[static_cast<size_t>(priority)]++;
+    }
+    wake_.notify_one();
+    if(priority == Priority::High)
+        groupWake_.notify_all();
+}
+
+bool Executor::runOne(const Priority lowestPriority)
+{
+    const size_t ownQueue = currentExecutor == this ? currentQueue : 0;
+    std::function<void()> task;
+    for(size_t priority = 0; priority <= static_cast<size_t>(lowestPriority) && !task; priority++)
+    {
+        for(size_t i = 0; i < queues_.size() && !task; i++)
+        {
+            WorkerQueue& queue = *queues_[(ownQueue + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            auto& tasks = queue.tasks[priority];
+            if(tasks.empty())
+                continue;
+            // Own tasks are taken LIFO for locality, stolen ones FIFO as they are usually the larger ones
+            if(i == 0 && currentExecutor == this)
+            {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+            } else
+            {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            numQueued_[priority]--;
+        }
+    }
+    if(!task)
+        return false;
+    task();
+    return true;
+}
+
+void Executor::workerLoop(size_t idx)
+{
+    currentExecutor = this;
+    currentQueue = idx;
+    while(true)
+    {
+        if(runOne(Priority::Normal))
+            continue;
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait(lock, [this]() { return stop_ || numQueued_[0] > 0 || numQueued_[1] > 0; });
+        if(stop_)
+            break;
+    }
+}
+
+void setExecutorThreads(unsigned numThreads)
+{
+    executorThreads = numThreads;
+}
+
+Executor& getExecutor()
+{
+    static Executor executor(executorThreads ? executorThreads : std::thread::hardware_concurrency());
+    return executor;
+}
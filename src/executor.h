@@ -0,0 +1,97 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Work-stealing thread pool for all CPU-bound work (hashing, decompression, ...).
+/// Each worker has its own queues and steals from the others when they are empty.
+/// Threads waiting for a TaskGroup run queued high priority tasks meanwhile, so tasks can wait for nested tasks.
+/// Nested tasks must therefore use the high priority.
+class Executor
+{
+public:
+    enum class Priority
+    {
+        /// Work for files already in progress, run before any normal task
+        High,
+        /// Work which starts processing a new file
+        Normal
+    };
+
+    /// Set of tasks which can be waited for together
+    class TaskGroup
+    {
+    public:
+        explicit TaskGroup(Executor& executor) : executor_(executor) {}
+        /// Waits for all tasks, but discards their exceptions
+        ~TaskGroup();
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void run(std::function<void()> task, Priority priority = Priority::Normal);
+        /// Wait until all tasks finished, running high priority tasks meanwhile. Normal tasks are not run, so a
+        /// thread waiting for the work of one file does not start other files. Rethrows the first exception of a task
+        void wait();
+
+    private:
+        Executor& executor_;
+        std::atomic<size_t> pending_{0};
+        std::mutex errorMutex_;
+        std::exception_ptr error_;
+    };
+
+    /// Create the executor for numThreads threads including the one waiting for the tasks, but at least one worker.
+    /// The waiting thread only helps with high priority tasks
+    explicit Executor(unsigned numThreads);
+    ~Executor();
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    /// Number of threads running tasks including the waiting one
+    unsigned getNumThreads() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        /// One queue per priority
+        std::array<std::deque<std::function<void()>>, 2> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+    /// Number of queued tasks per priority
+    std::array<std::atomic<size_t>, 2> numQueued_{};
+    std::atomic<size_t> nextQueue_{0};
+    std::mutex wakeMutex_;
+    /// Signaled for idle workers when a task is queued
+    std::condition_variable wake_;
+    /// Signaled for threads waiting for a TaskGroup when a high priority task is queued or a group finished
+    std::condition_variable groupWake_;
+    bool stop_ = false;
+
+    void submit(std::function<void()> task, Priority priority);
+    /// Run one queued task of at least the given priority, preferring the queue of the current worker.
+    /// Return false if there was none
+    bool runOne(Priority lowestPriority);
+    void workerLoop(size_t idx);
+};
+
+/// Set the number of threads of the executor returned by getExecutor, i.e. the workers plus the thread waiting for
+/// the tasks. As there is always at least one worker, 1 gives the same executor as 2.
+/// Only has an effect before its first use
+void setExecutorThreads(unsigned numThreads);
+/// Executor shared by all stages of the process. Uses all cores by default
+Executor& getExecutor();
@@ -0,0 +1,138 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "fileMetadata.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+#include <numeric>
+#include <string_view>
+#ifndef _WIN32
+#    include <fcntl.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace bfs = boost::filesystem;
+
+namespace {
+
+#ifdef _WIN32
+
+FileMetadata statAt(const std::string& path)
+{
+    FileMetadata result;
+    boost::system::error_code ec;
+    result.exists = bfs::is_regular_file(path, ec);
+    result.parentExists = result.exists || bfs::is_directory(bfs::path(path).parent_path(), ec);
+    if(result.exists)
+    {
+        result.size = bfs::file_size(path, ec);
+        result.mtime_ns = static_cast<int64_t>(bfs::last_write_time(path, ec)) * 1000000000;
+    }
+    return result;
+}
+
+#else
+
+/// Query the metadata of name relative to the opened directory dirFd
+FileMetadata statAt(int dirFd, const char* name)
+{
+    FileMetadata result;
+    result.parentExists = true;
+#    if defined(__linux__) && defined(STATX_BASIC_STATS)
+    // statx allows requesting only what we need which saves work on some filesystems (e.g. network FS)
+    struct statx stx;
+    if(statx(dirFd, name, AT_STATX_DONT_SYNC, STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) == 0)
+    {
+        result.exists = S_ISREG(stx.stx_mode);
+        result.size = stx.stx_size;
+        result.mtime_ns = static_cast<int64_t>(stx.stx_mtime.tv_sec) * 1000000000 + stx.stx_mtime.tv_nsec;
+        result.inode = stx.stx_ino;
+        return result;
+    }
+    if(errno != ENOSYS)
+        return result;
+#    endif
+    struct stat st;
+    if(fstatat(dirFd, name, &st, 0) != 0)
+        return result;
+    result.exists = S_ISREG(st.st_mode);
+    result.size = static_cast<uint64_t>(st.st_size);
+#    ifdef __APPLE__
+    const timespec& mtime = st.st_mtimespec;
+#    else
+    const timespec& mtime = st.st_mtim;
+#    endif
+    result.mtime_ns = static_cast<int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+    result.inode = st.st_ino;
+    return result;
+}
+
+/// Directory and filename of a path, both referring to the path
+struct SplitPath
+{
+    std::string_view dir;
+    /// Null terminated
+    const char* name;
+};
+
+SplitPath splitPath(const std::string& path)
+{
+    const auto slashPos = path.rfind('/');
+    if(slashPos == std::string::npos)
+        return {".", path.c_str()};
+    if(slashPos == 0)
+        return {"/", path.c_str() + 1};
+    return {std::string_view(path).substr(0, slashPos), path.c_str() + slashPos + 1};
+}
+
+#endif
+
+} // namespace
+
+FileMetadata statFile(const std::string& path)
+{
+#ifdef _WIN32
+    return statAt(path);
+#else
+    return scanMetadata({path}).front();
+#endif
+}
+
+std::vector<FileMetadata> scanMetadata(const std::vector<std::string>& paths)
+{
+    std::vector<FileMetadata> result(paths.size());
+#ifdef _WIN32
+    std::transform(paths.begin(), paths.end(), result.begin(), statAt);
+#else
+    // Refer to the paths instead of copying them, as there may be millions
+    std::vector<SplitPath> splitPaths;
+    splitPaths.reserve(paths.size());
+    std::transform(paths.begin(), paths.end(), std::back_inserter(splitPaths), splitPath);
+
+    // Process all files of a directory together
+    std::vector<size_t> order(paths.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&splitPaths](size_t lhs, size_t rhs) { return splitPaths[lhs].dir < splitPaths[rhs].dir; });
+
+    for(auto it = order.begin(); it != order.end();)
+    {
+        const std::string_view dir = splitPaths[*it].dir;
+        const auto itEnd = std::find_if(
+          it, order.end(), [&splitPaths, dir](size_t idx) { return splitPaths[idx].dir != dir; });
+        const int dirFd = open(std::string(dir).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(dirFd >= 0)
+        {
+            for(; it != itEnd; ++it)
+                result[*it] = statAt(dirFd, splitPaths[*it].name);
+            close(dirFd);
+        }
+        it = itEnd;
+    }
+#endif
+    return result;
+}
@@ -0,0 +1,27 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Filesystem metadata of a managed file
+struct FileMetadata
+{
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    uint64_t inode = 0;
+    /// Path exists and is a regular file (symlinks are followed)
+    bool exists = false;
+    /// Parent directory of the path exists
+    bool parentExists = false;
+};
+
+/// Get the metadata of a single file
+FileMetadata statFile(const std::string& path);
+/// Get the metadata of all given files. Result has one entry per path in the same order.
+/// Paths are grouped by directory so every directory is only opened once and its files are queried relative to it.
+std::vector<FileMetadata> scanMetadata(const std::vector<std::string>& paths);
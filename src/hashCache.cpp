@@ -0,0 +1,272 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "hashCache.h"
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/nowide/cstdio.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace bfs = boost::filesystem;
+namespace bip = boost::interprocess;
+
+namespace {
+constexpr std::array<char, 8> cacheMagic = {'S', '2', '5', 'H', 'C', 'A', 'C', 'H'};
+constexpr uint32_t cacheVersion = 2;
+
+struct CacheHeader
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t numRecords;
+    uint32_t poolSize;
+    /// CRC32 of records and string pool
+    uint32_t checksum;
+    uint64_t reserved;
+};
+
+struct CacheRecord
+{
+    uint64_t pathHash;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    /// Number of used bytes in digest, depends on the hash algorithm
+    uint32_t digestSize;
+    uint32_t reserved;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t inode;
+    std::array<uint8_t, 32> digest;
+};
+
+static_assert(sizeof(CacheHeader) == 32, "Unexpected padding");
+static_assert(sizeof(CacheRecord) == 80, "Unexpected padding");
+
+/// FNV-1a
+uint64_t hashPath(const std::string& path)
+{
+    uint64_t result = 14695981039346656037ull;
+    for(const char c : path)
+    {
+        result ^= static_cast<uint8_t>(c);
+        result *= 1099511628211ull;
+    }
+    return result;
+}
+
+int hexValue(char c)
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool hexToDigest(const std::string& hex, std::array<uint8_t, 32>& digest, uint32_t& digestSize)
+{
+    if(hex.size() % 2 != 0 || hex.size() > digest.size() * 2)
+        return false;
+    digestSize = static_cast<uint32_t>(hex.size() / 2);
+    for(size_t i = 0; i < digestSize; i++)
+    {
+        const int hi = hexValue(hex[i * 2]);
+        const int lo = hexValue(hex[i * 2 + 1]);
+        if(hi < 0 || lo < 0)
+            return false;
+        digest[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    return true;
+}
+
+std::string digestToHex(const std::array<uint8_t, 32>& digest, uint32_t digestSize)
+{
+    static constexpr char hexDigits[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(digestSize * 2);
+    for(uint32_t i = 0; i < digestSize; i++)
+    {
+        const uint8_t value = digest[i];
+        result += hexDigits[value >> 4];
+        result += hexDigits[value & 0xF];
+    }
+    return result;
+}
+
+uint32_t calcChecksum(const char* data, size_t size)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+} // namespace
+
+HashCache::HashCache(bfs::path filePath) : filePath_(std::move(filePath))
+{
+    load();
+}
+
+HashCache::~HashCache() = default;
+
+void HashCache::load()
+{
+    boost::system::error_code ec;
+    if(!bfs::is_regular_file(filePath_, ec) || bfs::file_size(filePath_, ec) < sizeof(CacheHeader))
+        return;
+    try
+    {
+        bip::file_mapping file(filePath_.string().c_str(), bip::read_only);
+        region_ = std::make_unique<bip::mapped_region>(file, bip::read_only);
+    } catch(const bip::interprocess_exception&)
+    {
+        return;
+    }
+    const auto* data = static_cast<const char*>(region_->get_address());
+    const size_t size = region_->get_size();
+
+    CacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const uint64_t expectedSize =
+      sizeof(header) + static_cast<uint64_t>(header.numRecords) * sizeof(CacheRecord) + header.poolSize;
+    if(header.magic != cacheMagic || header.version != cacheVersion || expectedSize != size
+       || calcChecksum(data + sizeof(header), size - sizeof(header)) != header.checksum)
+    {
+        region_.reset();
+        return;
+    }
+    data_ = data;
+    numRecords_ = header.numRecords;
+}
+
+boost::optional<std::string> HashCache::lookup(const std::string& path, const FileMetadata& metadata) const
+{
+    if(!data_)
+        return boost::none;
+    const char* records = data_ + sizeof(CacheHeader);
+    const char* pool = records + static_cast<size_t>(numRecords_) * sizeof(CacheRecord);
+    const size_t poolSize = region_->get_size() - (pool - data_);
+    const auto readRecord = [records](uint32_t idx) {
+        CacheRecord record;
+        std::memcpy(&record, records + static_cast<size_t>(idx) * sizeof(CacheRecord), sizeof(record));
+        return record;
+    };
+
+    const uint64_t pathHash = hashPath(path);
+    // Lower bound of the path hash
+    uint32_t first = 0, count = numRecords_;
+    while(count > 0)
+    {
+        const uint32_t step = count / 2;
+        if(readRecord(first + step).pathHash < pathHash)
+        {
+            first += step + 1;
+            count -= step + 1;
+        } else
+            count = step;
+    }
+    for(; first < numRecords_; ++first)
+    {
+        const CacheRecord record = readRecord(first);
+        if(record.pathHash != pathHash)
+            break;
+        if(static_cast<uint64_t>(record.pathOffset) + record.pathLength > poolSize
+           || path.compare(0, std::string::npos, pool + record.pathOffset, record.pathLength) != 0)
+            continue;
+        if(record.size != metadata.size || record.mtime_ns != metadata.mtime_ns || record.inode != metadata.inode
+           || record.digestSize > record.digest.size())
+            return boost::none;
+        return digestToHex(record.digest, record.digestSize);
+    }
+    return boost::none;
+}
+
+void HashCache::update(const std::string& path, const FileMetadata& metadata, const std::string& digest)
+{
+    Entry entry{metadata, {}, 0};
+    std::lock_guard<std::mutex> lock(newEntriesMutex_);
+    if(metadata.exists && hexToDigest(digest, entry.digest, entry.digestSize))
+        newEntries_[path] = entry;
+    else
+        newEntries_.erase(path);
+}
+
+void HashCache::invalidate(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(newEntriesMutex_);
+    newEntries_.erase(path);
+}
+
+bool HashCache::save()
+{
+    // Release the mapping so the file can be replaced
+    region_.reset();
+    data_ = nullptr;
+    numRecords_ = 0;
+
+    std::vector<std::pair<uint64_t, const std::pair<const std::string, Entry>*>> sortedEntries;
+    sortedEntries.reserve(newEntries_.size());
+    for(const auto& entry : newEntries_)
+        sortedEntries.emplace_back(hashPath(entry.first), &entry);
+    std::sort(sortedEntries.begin(), sortedEntries.end(),
+              [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+    // Written record by record, as the cache of a large installation has millions of entries.
+    // The header is written last, once the checksum is known
+    bfs::path tmpPath = filePath_;
+    tmpPath += ".tmp";
+    FILE* fp = boost::nowide::fopen(tmpPath.string().c_str(), "wb");
+    if(!fp)
+        return false;
+    boost::crc_32_type crc;
+    bool ok = fseek(fp, sizeof(CacheHeader), SEEK_SET) == 0;
+    uint64_t poolSize = 0;
+    for(const auto& it : sortedEntries)
+    {
+        const std::string& path = it.second->first;
+        const Entry& entry = it.second->second;
+        CacheRecord record{it.first,
+                           static_cast<uint32_t>(poolSize),
+                           static_cast<uint32_t>(path.size()),
+                           entry.digestSize,
+                           0,
+                           entry.metadata.size,
+                           entry.metadata.mtime_ns,
+                           entry.metadata.inode,
+                           entry.digest};
+        poolSize += path.size();
+        crc.process_bytes(&record, sizeof(record));
+        ok &= fwrite(&record, sizeof(record), 1, fp) == 1;
+    }
+    for(const auto& it : sortedEntries)
+    {
+        const std::string& path = it.second->first;
+        crc.process_bytes(path.data(), path.size());
+        if(!path.empty())
+            ok &= fwrite(path.data(), path.size(), 1, fp) == 1;
+    }
+    ok &= poolSize <= std::numeric_limits<uint32_t>::max();
+
+    const CacheHeader header{cacheMagic, cacheVersion, static_cast<uint32_t>(sortedEntries.size()),
+                             static_cast<uint32_t>(poolSize), crc.checksum(), 0};
+    ok &= fseek(fp, 0, SEEK_SET) == 0;
+    ok &= fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok &= fclose(fp) == 0;
+    boost::system::error_code ec;
+    if(ok)
+        bfs::rename(tmpPath, filePath_, ec);
+    if(!ok || ec)
+    {
+        bfs::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "fileMetadata.h"
+#include <boost/filesystem/path.hpp>
+#include <boost/optional.hpp>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace boost { namespace interprocess {
+    class mapped_region;
+}} // namespace boost::interprocess
+
+/// Persistent cache of file digests, valid as long as size, mtime and inode of the file are unchanged.
+/// The file consists of a header, fixed-size records sorted by the hash of the path and a pool of the path strings.
+/// It is mapped into memory on load, so lookups are binary searches without parsing the whole file.
+class HashCache
+{
+public:
+    /// Load the cache from the file. A missing, outdated or corrupt file results in an empty cache
+    explicit HashCache(boost::filesystem::path filePath);
+    ~HashCache();
+
+    /// Get the cached digest of the file if it is known and its metadata did not change
+    boost::optional<std::string> lookup(const std::string& path, const FileMetadata& metadata) const;
+    /// Remember the digest of the file for the next run. Thread-safe
+    void update(const std::string& path, const FileMetadata& metadata, const std::string& digest);
+    /// Forget the digest of the file, e.g. because it was modified. Thread-safe
+    void invalidate(const std::string& path);
+    /// Atomically replace the cache file by the entries passed to update
+    bool save();
+
+private:
+    struct Entry
+    {
+        FileMetadata metadata;
+        /// Large enough for all supported hash algorithms
+        std::array<uint8_t, 32> digest;
+        uint32_t digestSize;
+    };
+
+    boost::filesystem::path filePath_;
+    std::unique_ptr<boost::interprocess::mapped_region> region_;
+    const char* data_ = nullptr;
+    uint32_t numRecords_ = 0;
+    std::mutex newEntriesMutex_;
+    std::unordered_map<std::string, Entry> newEntries_;
+
+    void load();
+};
@@ -3,9 +3,19 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #include "md5sum.h"
+#include "blake3.h"
+#include "executor.h"
 #include "s25util/md5.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/nowide/cstdio.hpp>
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <vector>
+
+namespace bip = boost::interprocess;
 
 int md5file(FILE* fp, std::string& digest)
 {
@@ -24,3 +34,109 @@ int md5file(FILE* fp, std::string& digest)
         return -1;
     return 0;
 }
+
+int md5range(FILE* fp, uint64_t length, std::string& digest)
+{
+    if(!fp)
+        return -1;
+    std::array<uint8_t, 1024> buf;
+    s25util::md5 md5("");
+
+    size_t n;
+    while(length > 0
+          && (n = fread(buf.data(), 1, static_cast<size_t>(std::min<uint64_t>(buf.size(), length)), fp)) > 0)
+    {
+        md5.process(buf.data(), n, true);
+        length -= n;
+    }
+
+    digest = md5.toString();
+
+    if(ferror(fp))
+        return -1;
+    return 0;
+}
+
+namespace {
+/// Hash the file with BLAKE3 by reading it sequentially, used if it can't be mapped
+std::string blake3file(const std::string& filePath)
+{
+    FILE* fp = boost::nowide::fopen(filePath.c_str(), "rb");
+    if(!fp)
+        return "";
+    std::vector<uint8_t> buf(256 * 1024);
+    Blake3 blake3;
+    size_t n;
+    while((n = fread(buf.data(), 1, buf.size(), fp)) > 0)
+        blake3.update(buf.data(), n);
+    const bool ok = !ferror(fp);
+    fclose(fp);
+    return ok ? blake3.toString() : "";
+}
+} // namespace
+
+std::string md5string(const std::string& data)
+{
+    s25util::md5 md5("");
+    md5.process(data.data(), data.size(), true);
+    return md5.toString();
+}
+
+Md5Hash::Md5Hash() : md5_(std::make_unique<s25util::md5>("")) {}
+
+Md5Hash::~Md5Hash() = default;
+
+void Md5Hash::update(const void* data, size_t size)
+{
+    md5_->process(data, size, true);
+}
+
+std::string Md5Hash::toString() const
+{
+    return md5_->toString();
+}
+
+HashAlgorithm getHashAlgorithm(const std::string& digest)
+{
+    return digest.size() == getDigestLength(HashAlgorithm::BLAKE3) ? HashAlgorithm::BLAKE3 : HashAlgorithm::MD5;
+}
+
+size_t getDigestLength(HashAlgorithm algorithm)
+{
+    return algorithm == HashAlgorithm::BLAKE3 ? Blake3::digestSize * 2 : 32;
+}
+
+std::string hashFile(const std::string& filePath, HashAlgorithm algorithm)
+{
+    if(algorithm == HashAlgorithm::MD5)
+    {
+        std::string digest;
+        FILE* fp = boost::nowide::fopen(filePath.c_str(), "rb");
+        if(fp)
+        {
+            if(md5file(fp, digest) != 0)
+                digest.clear();
+            fclose(fp);
+        }
+        return digest;
+    }
+
+    // Map the whole file so the BLAKE3 tree can be hashed by all cores without copying
+    boost::system::error_code ec;
+    const auto fileSize = boost::filesystem::file_size(filePath, ec);
+    if(ec)
+        return "";
+    if(fileSize == 0)
+        return Blake3().toString();
+    try
+    {
+        bip::file_mapping file(filePath.c_str(), bip::read_only);
+        bip::mapped_region region(file, bip::read_only);
+        region.advise(bip::mapped_region::advice_sequential);
+        return Blake3::hashBuffer(region.get_address(), region.get_size(), &getExecutor());
+    } catch(const bip::interprocess_exception&)
+    {
+        // E.g. larger than the address space of 32 bit targets
+        return blake3file(filePath);
+    }
+}
@@ -5,7 +5,47 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <memory>
 #include <string>
 
+namespace s25util {
+class md5;
+}
+
 int md5file(FILE* fp, std::string& digest);
+/// Hash at most length bytes starting at the current position of fp
+int md5range(FILE* fp, uint64_t length, std::string& digest);
+std::string md5string(const std::string& data);
+
+/// Incremental MD5 hash with the same interface as Blake3
+class Md5Hash
+{
+public:
+    Md5Hash();
+    ~Md5Hash();
+    /// Add data to the hash
+    void update(const void* data, size_t size);
+    /// Get the hex digest of all data added so far
+    std::string toString() const;
+
+private:
+    std::unique_ptr<s25util::md5> md5_;
+};
+
+/// Hash algorithms used by the file lists
+enum class HashAlgorithm
+{
+    MD5,
+    BLAKE3
+};
+
+/// Get the algorithm of a hex digest by its length
+HashAlgorithm getHashAlgorithm(const std::string& digest);
+/// Get the length of the hex digests of the algorithm
+size_t getDigestLength(HashAlgorithm algorithm);
+/// Calculate the hex digest of a file. Large files are hashed using multiple threads if the algorithm supports it.
+/// Return an empty string on error
+std::string hashFile(const std::string& filePath, HashAlgorithm algorithm);
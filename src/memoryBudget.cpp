@@ -0,0 +1,69 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "memoryBudget.h"
+#include <algorithm>
+
+MemoryBudget::Lease::Lease(MemoryBudget& budget, uint64_t size) : budget_(budget)
+{
+    resize(size);
+}
+
+MemoryBudget::Lease::~Lease()
+{
+    resize(0);
+}
+
+void MemoryBudget::Lease::resize(uint64_t size)
+{
+    if(size > size_)
+        budget_.acquire(size - size_, size_);
+    else if(size < size_)
+        budget_.release(size_ - size);
+    size_ = size;
+}
+
+void MemoryBudget::setLimit(uint64_t limit)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limit_ = limit;
+    }
+    released_.notify_all();
+}
+
+uint64_t MemoryBudget::getLimit() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limit_;
+}
+
+uint64_t MemoryBudget::getPeak() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return peak_;
+}
+
+void MemoryBudget::acquire(uint64_t size, uint64_t ownedSize)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_.wait(lock, [&]() { return limit_ == 0 || used_ + size <= limit_ || used_ <= ownedSize; });
+    used_ += size;
+    peak_ = std::max(peak_, used_);
+}
+
+void MemoryBudget::release(uint64_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_ -= std::min(size, used_);
+    }
+    released_.notify_all();
+}
+
+MemoryBudget& getMemoryBudget()
+{
+    static MemoryBudget budget;
+    return budget;
+}
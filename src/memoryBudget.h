@@ -0,0 +1,57 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/// Limit for the memory of the buffers used by transfers and decompression.
+/// Stages reserve the size of their buffers before using them and wait while other stages hold the remaining memory.
+class MemoryBudget
+{
+public:
+    /// Memory reserved by a stage, released on destruction
+    class Lease
+    {
+    public:
+        explicit Lease(MemoryBudget& budget, uint64_t size = 0);
+        ~Lease();
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        /// Change the reserved size, waiting for memory to become available if it grows
+        void resize(uint64_t size);
+        uint64_t size() const { return size_; }
+
+    private:
+        MemoryBudget& budget_;
+        uint64_t size_ = 0;
+    };
+
+    /// Create a budget with the given limit in bytes, 0 for unlimited
+    explicit MemoryBudget(uint64_t limit = 0) : limit_(limit) {}
+
+    void setLimit(uint64_t limit);
+    uint64_t getLimit() const;
+    /// Highest amount of memory reserved at once
+    uint64_t getPeak() const;
+
+    /// Reserve the memory, waiting until enough was released by other holders.
+    /// ownedSize is the amount already reserved by the caller. If nothing else is reserved the limit may be exceeded,
+    /// so a single buffer larger than the limit does not block forever
+    void acquire(uint64_t size, uint64_t ownedSize = 0);
+    void release(uint64_t size);
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    uint64_t limit_;
+    uint64_t used_ = 0;
+    uint64_t peak_ = 0;
+};
+
+/// Budget shared by all stages of the process, unlimited by default
+MemoryBudget& getMemoryBudget();
@@ -0,0 +1,243 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Publisher tool creating the delta patches of a new build from earlier builds, which the updater prefers over
+// downloading whole files. Usage: s25update-mkdelta [--threads <n>] [--min-savings <percent>] <new> <old>...
+// Each build is a published updater directory with its file list, files and payloads. The patches are written to
+// <new>/delta and listed in the index <new>/deltas. --threads counts the workers + 1 for the main thread, which only
+// waits for them, so 1 and 2 both create the patches on a single worker.
+
+#include "deltaPatch.h"
+#include "executor.h"
+#include <boost/filesystem.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <boost/nowide/iostream.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bfs = boost::filesystem;
+namespace bnw = boost::nowide;
+
+#define FILELIST "files"
+#define FILELISTV2 "files.v2"
+#define DELTALIST "deltas"
+#define DELTAPATH "delta"
+
+namespace {
+
+/// A patch to create
+struct DeltaJob
+{
+    std::string oldDigest;
+    std::string newDigest;
+    bfs::path oldFilePath;
+    bfs::path newFilePath;
+    /// Size of the payload of the whole new file, which the patch must be smaller than
+    uint64_t payloadSize;
+};
+
+bfs::path getFileListPath(const bfs::path& buildPath, const bool useV2)
+{
+    return buildPath / (useV2 ? FILELISTV2 : FILELIST);
+}
+
+/// Read the file list of a published build, preferring the BLAKE3 one like the updater.
+/// Return the digest of each path
+std::unordered_map<std::string, std::string> readFileList(const bfs::path& buildPath, const bool useV2)
+{
+    bnw::ifstream file(getFileListPath(buildPath, useV2));
+    if(!file)
+        throw std::runtime_error("Missing file list in " + buildPath.string());
+    std::unordered_map<std::string, std::string> result;
+    std::string line;
+    while(getline(file, line) && !line.empty())
+    {
+        // Format: <hash>  <filePath>
+        const size_t hashLen = line.find("  ");
+        if(hashLen == std::string::npos)
+            throw std::runtime_error("Invalid line in file list of " + buildPath.string() + ": " + line);
+        result[line.substr(hashLen + 2)] = line.substr(0, hashLen);
+    }
+    return result;
+}
+
+uint64_t getPayloadSize(const bfs::path& filePath)
+{
+    bfs::path payloadPath = filePath;
+    payloadPath += ".bz2";
+    boost::system::error_code ec;
+    const uint64_t payloadSize = bfs::file_size(payloadPath, ec);
+    return ec ? bfs::file_size(filePath) : payloadSize;
+}
+
+void createDeltas(const bfs::path& newBuildPath, const std::vector<bfs::path>& oldBuildPaths,
+                  const double minSavings)
+{
+    const bool useV2 = bfs::exists(newBuildPath / FILELISTV2);
+    const auto newFiles = readFileList(newBuildPath, useV2);
+
+    std::vector<DeltaJob> jobs;
+    std::set<std::pair<std::string, std::string>> knownPairs;
+    for(const bfs::path& oldBuildPath : oldBuildPaths)
+    {
+        // Digests of different algorithms can't be matched, e.g. for builds published before BLAKE3 was introduced
+        if(!bfs::exists(getFileListPath(oldBuildPath, useV2)))
+        {
+            bnw::cerr << "Warning: Skipping " << oldBuildPath << " without " << (useV2 ? FILELISTV2 : FILELIST)
+                      << std::endl;
+            continue;
+        }
+        for(const auto& oldFile : readFileList(oldBuildPath, useV2))
+        {
+            const auto itNew = newFiles.find(oldFile.first);
+            if(itNew == newFiles.end() || itNew->second == oldFile.second
+               || knownPairs.count(std::make_pair(oldFile.second, itNew->second)))
+                continue;
+            const bfs::path oldFilePath = (oldBuildPath / oldFile.first).lexically_normal();
+            // Another old build might still have the file
+            if(!bfs::is_regular_file(oldFilePath))
+            {
+                bnw::cerr << "Warning: Skipping missing " << oldFilePath << std::endl;
+                continue;
+            }
+            knownPairs.emplace(oldFile.second, itNew->second);
+            const bfs::path newFilePath = (newBuildPath / itNew->first).lexically_normal();
+            jobs.push_back({oldFile.second, itNew->second, oldFilePath, newFilePath, getPayloadSize(newFilePath)});
+        }
+    }
+    // Start with the largest files, so they don't delay the end
+    std::sort(jobs.begin(), jobs.end(),
+              [](const DeltaJob& lhs, const DeltaJob& rhs) { return lhs.payloadSize > rhs.payloadSize; });
+
+    const bfs::path deltaDirPath = newBuildPath / DELTAPATH;
+    bfs::create_directories(deltaDirPath);
+    std::mutex indexMutex;
+    delta::Index index;
+    std::atomic<size_t> numSkipped(0);
+    std::atomic<size_t> numFailed(0);
+    Executor::TaskGroup group(getExecutor());
+    for(const DeltaJob& job : jobs)
+    {
+        group.run([&job, &deltaDirPath, &indexMutex, &index, &numSkipped, &numFailed, minSavings]() {
+            const std::string name = job.oldDigest + "-" + job.newDigest;
+            const bfs::path patchPath = deltaDirPath / name;
+            bfs::path tmpPath = patchPath;
+            tmpPath += ".tmp";
+            uint64_t patchSize;
+            try
+            {
+                patchSize = delta::createPatch(job.oldFilePath, job.newFilePath, tmpPath);
+            } catch(const std::exception& e)
+            {
+                // The updater downloads the whole file instead
+                boost::system::error_code ec;
+                bfs::remove(tmpPath, ec);
+                numFailed++;
+                std::lock_guard<std::mutex> lock(indexMutex);
+                bnw::cerr << "Warning: Skipping patch from " << job.oldFilePath << ": " << e.what() << std::endl;
+                return;
+            }
+            boost::system::error_code ec;
+            if(patchSize > job.payloadSize * (1 - minSavings))
+            {
+                // A remaining file is removed with the unused patches
+                bfs::remove(tmpPath, ec);
+                numSkipped++;
+                return;
+            }
+            bfs::rename(tmpPath, patchPath, ec);
+            std::lock_guard<std::mutex> lock(indexMutex);
+            if(ec)
+            {
+                bfs::remove(tmpPath, ec);
+                numFailed++;
+                bnw::cerr << "Warning: Skipping patch from " << job.oldFilePath << ": " << ec.message() << std::endl;
+                return;
+            }
+            index[std::make_pair(job.oldDigest, job.newDigest)] = {"./" DELTAPATH "/" + name, patchSize};
+        });
+    }
+    group.wait();
+
+    // Patches of earlier runs which are no longer useful
+    std::set<bfs::path> usedPaths;
+    for(const auto& entry : index)
+        usedPaths.insert(deltaDirPath / (entry.first.first + "-" + entry.first.second));
+    std::vector<bfs::path> unusedPaths;
+    for(const auto& entry : bfs::directory_iterator(deltaDirPath))
+    {
+        if(!usedPaths.count(entry.path()))
+            unusedPaths.push_back(entry.path());
+    }
+    size_t numNotRemoved = 0;
+    for(const bfs::path& path : unusedPaths)
+    {
+        boost::system::error_code ec;
+        bfs::remove(path, ec);
+        if(ec)
+        {
+            numNotRemoved++;
+            bnw::cerr << "Warning: Failed to remove unused " << path << ": " << ec.message() << std::endl;
+        }
+    }
+
+    const bfs::path indexPath = newBuildPath / DELTALIST;
+    bfs::path tmpIndexPath = indexPath;
+    tmpIndexPath += ".tmp";
+    {
+        bnw::ofstream indexFile(tmpIndexPath);
+        if(!(indexFile << delta::formatIndex(index)) || !indexFile.flush())
+            throw std::runtime_error("Failed to write " + tmpIndexPath.string());
+    }
+    bfs::rename(tmpIndexPath, indexPath);
+    bnw::cout << "Created " << index.size() << " patches, skipped " << numSkipped
+              << " not much smaller than the payload";
+    if(numFailed > 0)
+        bnw::cout << " and " << numFailed << " which failed";
+    bnw::cout << std::endl;
+    if(numNotRemoved > 0)
+        bnw::cout << "Kept " << numNotRemoved << " unused patches which could not be removed" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        double minSavings = 0.25;
+        std::vector<bfs::path> buildPaths;
+        for(int i = 1; i < argc; ++i)
+        {
+            if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                setExecutorThreads(static_cast<unsigned>(std::max(1, atoi(argv[++i]))));
+            else if(strcmp(argv[i], "--min-savings") == 0 && i + 1 < argc)
+                minSavings = std::min(100, std::max(0, atoi(argv[++i]))) / 100.;
+            else
+                buildPaths.emplace_back(argv[i]);
+        }
+        if(buildPaths.size() < 2)
+        {
+            bnw::cerr << "Usage: s25update-mkdelta [--threads <n>] [--min-savings <percent>] <new build> "
+                         "<old build>..."
+                      << std::endl;
+            return 1;
+        }
+        createDeltas(buildPaths.front(), std::vector<bfs::path>(buildPaths.begin() + 1, buildPaths.end()),
+                     minSavings);
+    } catch(const std::exception& e)
+    {
+        bnw::cerr << "Creating patches failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "objectCache.h"
+#include "md5sum.h"
+#include "writeThrottle.h"
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+namespace bfs = boost::filesystem;
+namespace bip = boost::interprocess;
+namespace bnw = boost::nowide;
+
+namespace {
+/// How often the owner of a lock marks the lock file
+constexpr std::chrono::minutes heartbeatInterval{1};
+static_assert(heartbeatInterval < ObjectCache::staleLockTimeout, "Owned locks must not become stale");
+
+/// Put srcPath at dstPath by a hardlink or by a copy if they are on different filesystems
+bool linkOrCopy(const bfs::path& srcPath, const bfs::path& dstPath)
+{
+    bfs::path tmpPath = dstPath;
+    tmpPath += "." + bfs::unique_path().string();
+    boost::system::error_code ec;
+    bfs::create_hard_link(srcPath, tmpPath, ec);
+    if(ec)
+    {
+        const uintmax_t size = bfs::file_size(srcPath, ec);
+        if(!ec)
+        {
+            getWriteThrottle().acquire(size);
+            bfs::copy_file(srcPath, tmpPath, ec);
+        }
+    }
+    if(!ec)
+        bfs::rename(tmpPath, dstPath, ec);
+    if(ec)
+    {
+        boost::system::error_code ignored;
+        bfs::remove(tmpPath, ignored);
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+constexpr std::chrono::minutes ObjectCache::staleLockTimeout;
+
+struct ObjectCache::ProducerLock::Heartbeat
+{
+    std::mutex mutex;
+    std::condition_variable stopped;
+    bool stop = false;
+    std::thread thread;
+
+    explicit Heartbeat(bfs::path lockPath)
+    {
+        thread = std::thread([this, lockPath = std::move(lockPath)]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(!stopped.wait_for(lock, heartbeatInterval, [this]() { return stop; }))
+            {
+                boost::system::error_code ec;
+                bfs::last_write_time(lockPath, std::time(nullptr), ec);
+            }
+        });
+    }
+    ~Heartbeat()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        stopped.notify_one();
+        thread.join();
+    }
+};
+
+ObjectCache::ProducerLock::ProducerLock(ProducerLock&&) noexcept = default;
+
+ObjectCache::ProducerLock::~ProducerLock()
+{
+    heartbeat_.reset();
+    if(lock_)
+        lock_->unlock();
+}
+
+ObjectCache::ObjectCache(bfs::path dirPath) : dirPath_(std::move(dirPath))
+{
+    bfs::create_directories(dirPath_);
+}
+
+bool ObjectCache::fetch(const std::string& digest, const bfs::path& targetPath) const
+{
+    const bfs::path objectPath = getObjectPath(digest);
+    boost::system::error_code ec;
+    if(!bfs::is_regular_file(objectPath, ec))
+        return false;
+    // Objects might have been modified through a hardlink in an installation
+    if(hashFile(objectPath.string(), getHashAlgorithm(digest)) != digest)
+    {
+        bfs::remove(objectPath, ec);
+        return false;
+    }
+    return linkOrCopy(objectPath, targetPath);
+}
+
+void ObjectCache::store(const std::string& digest, const bfs::path& filePath) const
+{
+    const bfs::path objectPath = getObjectPath(digest);
+    boost::system::error_code ec;
+    if(bfs::exists(objectPath, ec))
+        return;
+    bfs::create_directories(objectPath.parent_path(), ec);
+    linkOrCopy(filePath, objectPath);
+}
+
+ObjectCache::ProducerLock ObjectCache::lockProducer(const std::string& digest) const
+{
+    ProducerLock result;
+    bfs::path lockPath = getObjectPath(digest);
+    lockPath += ".lock";
+    boost::system::error_code ec;
+    bfs::create_directories(lockPath.parent_path(), ec);
+    // The lock file must exist and is never removed, as others might be waiting on it
+    {
+        bnw::ofstream lockFile(lockPath, std::ios::app);
+    }
+    std::unique_ptr<bip::file_lock> lock;
+    try
+    {
+        lock = std::make_unique<bip::file_lock>(lockPath.string().c_str());
+    } catch(const bip::interprocess_exception&)
+    {
+        // Without a lock (e.g. read-only cache) the object is produced independently
+        return result;
+    }
+
+    const std::time_t waitStart = std::time(nullptr);
+    const auto staleSeconds = std::chrono::seconds(staleLockTimeout).count();
+    while(!lock->try_lock())
+    {
+        // The owner marks the lock file when acquiring the lock and regularly while holding it
+        const std::time_t now = std::time(nullptr);
+        const std::time_t lockTime = bfs::last_write_time(lockPath, ec);
+        if(now - waitStart > staleSeconds && (ec || now - lockTime > staleSeconds))
+            return result;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    bfs::last_write_time(lockPath, std::time(nullptr), ec);
+    result.lock_ = std::move(lock);
+    result.heartbeat_ = std::make_unique<ProducerLock::Heartbeat>(lockPath);
+    return result;
+}
+
+bfs::path ObjectCache::getObjectPath(const std::string& digest) const
+{
+    // Spread objects over subdirectories to keep directories small
+    return dirPath_ / digest.substr(0, 2) / digest;
+}
@@ -0,0 +1,58 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace boost { namespace interprocess {
+    class file_lock;
+}} // namespace boost::interprocess
+
+/// Store of file contents by their digest, shared by all installations and updater processes on a host.
+/// Objects are hardlinked into installations where possible, so each content is only downloaded and written once.
+class ObjectCache
+{
+public:
+    /// Exclusive right to produce an object. Other processes wait for it, so only the owner downloads it
+    class ProducerLock
+    {
+    public:
+        ProducerLock(ProducerLock&&) noexcept;
+        ~ProducerLock();
+        /// False if waiting for the lock was given up, e.g. because its owner hangs
+        bool isOwned() const { return lock_ != nullptr; }
+
+    private:
+        friend class ObjectCache;
+        struct Heartbeat;
+        std::unique_ptr<boost::interprocess::file_lock> lock_;
+        /// Marks the lock file while the lock is owned, so waiting processes see that the owner is alive
+        std::unique_ptr<Heartbeat> heartbeat_;
+
+        ProducerLock() = default;
+    };
+
+    /// A lock whose owner did not mark it for this long is considered stale
+    static constexpr std::chrono::minutes staleLockTimeout{5};
+
+    /// Use the cache in dirPath, which is created if required
+    explicit ObjectCache(boost::filesystem::path dirPath);
+
+    /// Put the object with the digest at targetPath. Return false if it is not cached or corrupt
+    bool fetch(const std::string& digest, const boost::filesystem::path& targetPath) const;
+    /// Add the file with the given digest to the cache
+    void store(const std::string& digest, const boost::filesystem::path& filePath) const;
+    /// Wait until no other process produces the object. Locks of crashed processes are released by the OS and
+    /// locks not marked by their owner for staleLockTimeout are ignored, in which case the returned lock is not owned
+    ProducerLock lockProducer(const std::string& digest) const;
+
+private:
+    boost::filesystem::path dirPath_;
+
+    boost::filesystem::path getObjectPath(const std::string& digest) const;
+};
@@ -0,0 +1,61 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Thread-safe pool of reusable objects. Objects are created on demand and put back into the pool when the handle
+/// returned by acquire is destroyed, so the resources they hold (memory, connections, ...) are reused.
+/// The pool must outlive all handles
+template<class T>
+class ObjectPool
+{
+    struct Releaser
+    {
+        ObjectPool* pool;
+        void operator()(T* object) const { pool->release(object); }
+    };
+
+public:
+    using Handle = std::unique_ptr<T, Releaser>;
+
+    /// At most maxIdle unused objects are kept
+    explicit ObjectPool(size_t maxIdle = 16) : maxIdle_(maxIdle) {}
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    /// Get an unused object, which is in the state its last user left it
+    Handle acquire()
+    {
+        std::unique_ptr<T> object;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(!idle_.empty())
+            {
+                object = std::move(idle_.back());
+                idle_.pop_back();
+            }
+        }
+        if(!object)
+            object = std::make_unique<T>();
+        return Handle(object.release(), Releaser{this});
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<T>> idle_;
+    size_t maxIdle_;
+
+    void release(T* object)
+    {
+        std::unique_ptr<T> ownedObject(object);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(idle_.size() < maxIdle_)
+            idle_.push_back(std::move(ownedObject));
+    }
+};
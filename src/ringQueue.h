@@ -0,0 +1,233 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+/// Lock-free bounded ring queue for handing items between pipeline stages.
+/// tryPush/tryPop and the batch versions never block. push/pop only wait when the queue is full or empty,
+/// i.e. at the edges of the pipeline. After close() push fails and pop fails once the queue is drained.
+namespace ringQueue {
+
+namespace detail {
+    /// Waiting for a full/empty queue. Only touches the mutex if somebody is waiting
+    class EdgeWaiter
+    {
+    public:
+        template<class T_Ready>
+        void wait(const T_Ready& ready)
+        {
+            // Items usually arrive shortly, so yield a few times before sleeping
+            for(unsigned i = 0; i < 64; i++)
+            {
+                if(ready())
+                    return;
+                std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            waiters_++;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            cv_.wait(lock, ready);
+            waiters_--;
+        }
+        /// Wake waiters after the queue changed
+        void notify()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(waiters_.load(std::memory_order_relaxed) > 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                cv_.notify_all();
+            }
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::atomic<unsigned> waiters_{0};
+    };
+
+    inline size_t checkCapacity(size_t capacity)
+    {
+        if(capacity < 2 || (capacity & (capacity - 1)) != 0)
+            throw std::invalid_argument("Queue capacity must be a power of 2");
+        return capacity;
+    }
+
+    /// Blocking operations and closing, implemented by the non-blocking ones of T_Queue
+    template<class T_Queue, class T>
+    class BlockingOps
+    {
+    public:
+        /// Push the item, waiting while the queue is full. Return false if the queue was closed
+        bool push(T item)
+        {
+            while(!closed_)
+            {
+                if(self().tryPush(item))
+                    return true;
+                waiter_.wait([this]() { return closed_ || self().size() <= self().mask_; });
+            }
+            return false;
+        }
+        /// Pop an item, waiting while the queue is empty. Return false if the queue was closed and is empty
+        bool pop(T& item)
+        {
+            while(true)
+            {
+                if(self().tryPop(item))
+                    return true;
+                // Items pushed right before closing must not be lost
+                if(closed_)
+                    return self().tryPop(item);
+                waiter_.wait([this]() { return closed_ || self().size() > 0; });
+            }
+        }
+        /// Wake all waiting threads, no more items can be pushed
+        void close()
+        {
+            closed_ = true;
+            waiter_.notify();
+        }
+
+    protected:
+        detail::EdgeWaiter waiter_;
+        std::atomic<bool> closed_{false};
+
+    private:
+        T_Queue& self() { return static_cast<T_Queue&>(*this); }
+    };
+
+    /// Approximate number of items, exact if no other thread modifies the queue
+    inline size_t queueSize(const std::atomic<size_t>& head, const std::atomic<size_t>& tail)
+    {
+        const size_t headPos = head.load(std::memory_order_acquire);
+        const size_t tailPos = tail.load(std::memory_order_acquire);
+        return tailPos > headPos ? tailPos - headPos : 0;
+    }
+} // namespace detail
+
+/// Queue for any number of producer and consumer threads (bounded queue by D. Vyukov)
+template<class T>
+class MpmcQueue : public detail::BlockingOps<MpmcQueue<T>, T>
+{
+    friend class detail::BlockingOps<MpmcQueue<T>, T>;
+
+public:
+    /// Capacity must be a power of 2
+    explicit MpmcQueue(size_t capacity)
+        : mask_(detail::checkCapacity(capacity) - 1), cells_(std::make_unique<Cell[]>(capacity))
+    {
+        for(size_t i = 0; i < capacity; i++)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /// The item is only moved from if it was pushed
+    bool tryPush(T& item)
+    {
+        if(!tryPushNoNotify(item))
+            return false;
+        this->waiter_.notify();
+        return true;
+    }
+    bool tryPop(T& item)
+    {
+        if(!tryPopNoNotify(item))
+            return false;
+        this->waiter_.notify();
+        return true;
+    }
+    size_t size() const { return detail::queueSize(head_, tail_); }
+
+    /// Move up to count items into the queue, return the number of items pushed
+    size_t pushBatch(T* items, size_t count)
+    {
+        size_t numPushed = 0;
+        while(numPushed < count && tryPushNoNotify(items[numPushed]))
+            numPushed++;
+        if(numPushed > 0)
+            this->waiter_.notify();
+        return numPushed;
+    }
+    /// Move up to maxCount items out of the queue, return the number of items popped
+    size_t popBatch(T* items, size_t maxCount)
+    {
+        size_t numPopped = 0;
+        while(numPopped < maxCount && tryPopNoNotify(items[numPopped]))
+            numPopped++;
+        if(numPopped > 0)
+            this->waiter_.notify();
+        return numPopped;
+    }
+
+private:
+    struct Cell
+    {
+        /// Position which may access the cell next: pos for pushing, pos + 1 for popping
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+
+    bool tryPushNoNotify(T& item)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true)
+        {
+            cell = &cells_[pos & mask_];
+            const auto diff = static_cast<intptr_t>(cell->sequence.load(std::memory_order_acquire))
+                              - static_cast<intptr_t>(pos);
+            if(diff == 0)
+            {
+                if(tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if(diff < 0)
+                return false; // Full
+            else
+                pos = tail_.load(std::memory_order_relaxed);
+        }
+        cell->item = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPopNoNotify(T& item)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true)
+        {
+            cell = &cells_[pos & mask_];
+            const auto diff = static_cast<intptr_t>(cell->sequence.load(std::memory_order_acquire))
+                              - static_cast<intptr_t>(pos + 1);
+            if(diff == 0)
+            {
+                if(head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if(diff < 0)
+                return false; // Empty
+            else
+                pos = head_.load(std::memory_order_relaxed);
+        }
+        item = std::move(cell->item);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+} // namespace ringQueue
@@ -3,7 +3,27 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 
 #include "s25update.h" // IWYU pragma: keep
+#include "blake3.h"
+#include "bz2Decompressor.h"
+#include "changeWatcher.h"
+#include "chunkHashes.h"
+#include "deltaPatch.h"
+#include "executor.h"
+#include "fileMetadata.h"
+#include "hashCache.h"
 #include "md5sum.h"
+#include "memoryBudget.h"
+#include "objectCache.h"
+#include "objectPool.h"
+#include "ringQueue.h"
+#include "seekablePayload.h"
+#include "slotLayout.h"
+#include "smallFilePack.h"
+#include "stagedFile.h"
+#include "strategyPlanner.h"
+#include "transferSink.h"
+#include "updateJournal.h"
+#include "writeThrottle.h"
 #include "s25util/warningSuppression.h"
 #include <boost/filesystem.hpp>
 #include <boost/nowide/cstdio.hpp>
@@ -12,14 +32,30 @@
 #include <boost/optional.hpp>
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bzlib.h>
+#include <chrono>
+#include <cmath>
 #include <curl/curl.h>
+#include <exception>
 #include <iomanip>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
 #include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #ifdef _WIN32
 #    include <windows.h>
 #    include <shellapi.h>
+#else
+#    include <sys/resource.h>
 #endif
 
 #ifndef CURL_AT_LEAST_VERSION
@@ -57,8 +93,16 @@ namespace bnw = boost::nowide;
 #define NIGHTLYPATH "nightly/"
 #define FILEPATH "/updater"
 #define FILELIST "/files"
+#define FILELISTV2 "/files.v2"
 #define LINKLIST "/links"
+#define CHUNKLIST "/chunks"
+#define PACKLIST "/packs"
+#define DELTALIST "/deltas"
 #define SAVEGAMEVERSION "/savegameversion"
+#define HASHCACHE ".s25update-cache"
+#define JOURNAL ".s25update-journal"
+#define PLANNER ".s25update-planner"
+#define PACKCACHE ".s25update-packs"
 
 #ifndef SEE_MASK_NOASYNC
 #    define SEE_MASK_NOASYNC 0x00000100
@@ -90,32 +134,260 @@ short backslashrfix(short y)
 
 #endif // !_WIN32
 
-/**
- *  curl filewriter callback
- */
-size_t WriteCallback(void* ptr, size_t size, size_t nmemb, FILE* stream)
+/// Shares connections, DNS lookups and TLS sessions between all transfers of the process
+class CurlShare
+{
+public:
+    CurlShare() : handle_(curl_share_init())
+    {
+        curl_share_setopt(handle_, CURLSHOPT_LOCKFUNC, lock);     //-V111
+        curl_share_setopt(handle_, CURLSHOPT_UNLOCKFUNC, unlock); //-V111
+        curl_share_setopt(handle_, CURLSHOPT_USERDATA, this);     //-V111
+        curl_share_setopt(handle_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(handle_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if CURL_AT_LEAST_VERSION(7, 57, 00)
+        curl_share_setopt(handle_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    }
+    ~CurlShare() { curl_share_cleanup(handle_); }
+    CurlShare(const CurlShare&) = delete;
+    CurlShare& operator=(const CurlShare&) = delete;
+
+    CURLSH* get() const { return handle_; }
+
+private:
+    CURLSH* handle_;
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> mutexes_;
+
+    static void lock(CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+    {
+        static_cast<CurlShare*>(userptr)->mutexes_[data].lock();
+    }
+    static void unlock(CURL*, curl_lock_data data, void* userptr)
+    {
+        static_cast<CurlShare*>(userptr)->mutexes_[data].unlock();
+    }
+};
+
+/// Get the share handle used by all transfers. Must only be called after curl_global_init
+CURLSH* getCurlShare()
 {
-    size_t realsize = size * nmemb;
+    static CurlShare share;
+    return share.get();
+}
+
+/// Easy handle which keeps its connection cache when reused
+struct CurlHandle
+{
+    CURL* handle;
+
+    CurlHandle() : handle(curl_easy_init()) {}
+    ~CurlHandle() { curl_easy_cleanup(handle); }
+    CurlHandle(const CurlHandle&) = delete;
+    CurlHandle& operator=(const CurlHandle&) = delete;
+};
 
-    if(stream && realsize == fwrite(ptr, size, nmemb, stream))
-        return realsize;
+ObjectPool<CurlHandle>& getCurlHandlePool()
+{
+    // The handles use the share, so it must be destroyed after them
+    getCurlShare();
+    static ObjectPool<CurlHandle> pool;
+    return pool;
+}
+
+/// Pause of all transfers while the server is overloaded.
+/// An overload response of any transfer delays the requests of all transfers instead of each retrying on its own
+class ServerBackoff
+{
+public:
+    static constexpr std::chrono::seconds initialDelay{1};
+    static constexpr std::chrono::seconds maxDelay{300};
 
+    /// Wait until requests are allowed again
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while(std::chrono::steady_clock::now() < resumeTime_)
+        {
+            const auto resumeTime = resumeTime_;
+            lock.unlock();
+            std::this_thread::sleep_until(resumeTime);
+            lock.lock();
+        }
+    }
+    /// Pause all requests after the server signaled an overload. Without a delay requested by the server
+    /// the delay doubles with each consecutive overload. Return the delay
+    std::chrono::seconds onOverload(const boost::optional<std::chrono::seconds>& retryAfter)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const std::chrono::seconds delay = std::min(retryAfter.value_or(nextDelay_), maxDelay);
+        nextDelay_ = std::min(nextDelay_ * 2, maxDelay);
+        resumeTime_ = std::max(resumeTime_, std::chrono::steady_clock::now() + delay);
+        return delay;
+    }
+    void onSuccess()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        nextDelay_ = initialDelay;
+    }
+
+private:
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point resumeTime_;
+    std::chrono::seconds nextDelay_ = initialDelay;
+};
+
+constexpr std::chrono::seconds ServerBackoff::initialDelay;
+constexpr std::chrono::seconds ServerBackoff::maxDelay;
+
+ServerBackoff& getServerBackoff()
+{
+    static ServerBackoff backoff;
+    return backoff;
+}
+
+/// Wall time spent in the phases of the update, shown by --stats. Only used by the main thread
+class PhaseTimes
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// Add the duration to the phase, phases are shown in the order they were first added
+    void add(const std::string& phase, const Clock::duration duration)
+    {
+        const auto itPhase = std::find_if(phases_.begin(), phases_.end(),
+                                          [&phase](const auto& entry) { return entry.first == phase; });
+        if(itPhase == phases_.end())
+            phases_.emplace_back(phase, duration);
+        else
+            itPhase->second += duration;
+    }
+    void print(std::ostream& out) const
+    {
+        for(const auto& phase : phases_)
+        {
+            const std::chrono::duration<double> seconds = phase.second;
+            out << "Phase " << std::left << std::setw(20) << phase.first << std::right << std::fixed
+                << std::setprecision(3) << std::setw(9) << seconds.count() << "s" << std::endl;
+        }
+    }
+
+private:
+    std::vector<std::pair<std::string, Clock::duration>> phases_;
+};
+
+PhaseTimes& getPhaseTimes()
+{
+    static PhaseTimes phaseTimes;
+    return phaseTimes;
+}
+
+/// Highest amount of memory used by the process in bytes or 0 if unknown
+uint64_t getPeakMemoryUsage()
+{
+#ifdef _WIN32
     return 0;
+#else
+    rusage usage{};
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#    ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#    else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#    endif
+#endif
 }
 
-/**
- *  curl std::stringwriter callback
- */
-size_t WriteMemoryCallback(void* ptr, size_t size, size_t nmemb, std::string* data)
+/// Settings used by all transfers
+struct TransferSettings
+{
+    /// Base url of the update server, e.g. replaced by a mirror or a local test server
+    std::string server = HTTPHOST;
+    /// Abort connecting to the server or a transfer which stalled (below 1 byte/s) for this long
+    std::chrono::seconds stallTimeout{30};
+    /// Requests failing this often in a row are given up. Attempts which received data don't count
+    unsigned maxAttempts = 5;
+};
+
+TransferSettings& getTransferSettings()
 {
-    size_t realsize = size * nmemb;
+    static TransferSettings settings;
+    return settings;
+}
 
-    std::string tmp(reinterpret_cast<char*>(ptr), realsize);
-    *data += tmp;
+/// Check if a failed request might succeed when repeated. Overloads of the server are handled by ServerBackoff
+bool isTransientError(const CURLcode result, const long responseCode)
+{
+    switch(result)
+    {
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_RECV_ERROR:
+        case CURLE_SEND_ERROR:
+        case CURLE_GOT_NOTHING: return true;
+        case CURLE_HTTP_RETURNED_ERROR: return responseCode == 500 || responseCode == 502 || responseCode == 504;
+        default: return false;
+    }
+}
 
-    return realsize;
+/// Get the part of the range ("<first>-<last>" or "-<suffixLength>") behind the first numReceived bytes
+boost::optional<std::string> advanceRange(const std::string& range, const uint64_t numReceived)
+{
+    const size_t dashPos = range.find('-');
+    if(dashPos == std::string::npos || range.find_first_not_of("0123456789-") != std::string::npos)
+        return boost::none;
+    const std::string first = range.substr(0, dashPos), last = range.substr(dashPos + 1);
+    if(first.empty())
+    {
+        if(last.empty() || std::stoull(last) <= numReceived)
+            return boost::none;
+        return "-" + std::to_string(std::stoull(last) - numReceived);
+    }
+    return std::to_string(std::stoull(first) + numReceived) + "-" + last;
 }
 
+/// Stage in front of the sink of a transfer counting the data passed on, so an interrupted transfer can be resumed
+/// behind it. The data of a resumed request is rejected unless the server sends only the requested part
+template<class T_Sink>
+class ResumableSink
+{
+public:
+    ResumableSink(CURL* handle, T_Sink& sink) : handle_(handle), sink_(sink) {}
+    /// Start a request, which must be answered with partial content if it is resumed or requested a range
+    void beginRequest(const bool expectPartial)
+    {
+        expectPartial_ = expectPartial;
+        checked_ = false;
+    }
+    bool write(const char* data, size_t size)
+    {
+        if(!checked_)
+        {
+            // A server ignoring the range sends the file from the start, which the sink already received
+            long responseCode = 0;
+            curl_easy_getinfo(handle_, CURLINFO_RESPONSE_CODE, &responseCode);
+            if(expectPartial_ && responseCode != 206)
+                return false;
+            checked_ = true;
+        }
+        if(!sink_.write(data, size))
+            return false;
+        numReceived_ += size;
+        return true;
+    }
+    bool finish() { return sink_.finish(); }
+    uint64_t getNumReceived() const { return numReceived_; }
+
+private:
+    CURL* handle_;
+    T_Sink& sink_;
+    bool expectPartial_ = false;
+    bool checked_ = false;
+    uint64_t numReceived_ = 0;
+};
+
 /**
  *  curl progressbar callback
  */
@@ -146,8 +418,8 @@ int ProgressBarCallback(std::string* data, double dltotal, double dlnow, double
  */
 std::string EscapeFile(const std::string& file)
 {
-    CURL* curl_handle = curl_easy_init();
-    char* escaped = curl_easy_escape(curl_handle, file.c_str(), static_cast<int>(file.length()));
+    const auto curlHandle = getCurlHandlePool().acquire();
+    char* escaped = curl_easy_escape(curlHandle->handle, file.c_str(), static_cast<int>(file.length()));
     std::string result;
     if(escaped)
     {
@@ -155,47 +427,33 @@ std::string EscapeFile(const std::string& file)
         curl_free(escaped);
     }
 
-    curl_easy_cleanup(curl_handle);
-
     return result;
 }
 
 /**
- *  httpdownload function (to std::string or to file, with or without progressbar)
+ *  httpdownload function (into the given sink stage, with or without progressbar, optionally only a byte range)
+ *  Interrupted transfers are resumed behind the data already passed to the sink
  */
-bool DoDownloadFile(const std::string& url, std::string* to, const bfs::path& path = "",
-                    std::string* progress = nullptr)
+template<class T_Sink>
+bool DoDownloadFile(const std::string& url, T_Sink& sink, std::string* progress = nullptr,
+                    const std::string& range = "")
 {
-    FILE* tofp = nullptr;
-    bool ok = true;
-
-    bfs::path tmpPath = path;
-    tmpPath += ".new";
-
-    CURL* curl_handle = curl_easy_init();
+    const auto pooledHandle = getCurlHandlePool().acquire();
+    CURL* curl_handle = pooledHandle->handle;
+    curl_easy_reset(curl_handle);
 
     curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str()); //-V111
     curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "s25update/1.1");
     curl_easy_setopt(curl_handle, CURLOPT_FAILONERROR, 1);
+    curl_easy_setopt(curl_handle, CURLOPT_SHARE, getCurlShare()); //-V111
+    const long stallTimeout = static_cast<long>(getTransferSettings().stallTimeout.count());
+    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, stallTimeout);
+    curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_TIME, stallTimeout);
 
-    // Write file to Memory?
-    if(path.empty())
-    {
-        if(!to)
-            throw std::logic_error("No target for download given");
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback); //-V111
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, static_cast<void*>(to));  //-V111
-    } else
-    {
-        tofp = boost::nowide::fopen(tmpPath.string().c_str(), "wb");
-        if(!tofp)
-        {
-            bnw::cerr << "Can't open file \"" << tmpPath << "\"!!!!" << std::endl;
-            ok = false;
-        }
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteCallback);        //-V111
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, static_cast<void*>(tofp)); //-V111
-    }
+    ResumableSink<T_Sink> resumableSink(curl_handle, sink);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, sink::curlWrite<ResumableSink<T_Sink>>); //-V111
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, static_cast<void*>(&resumableSink));        //-V111
 
     // Show Progress?
     if(progress)
@@ -212,50 +470,175 @@ bool DoDownloadFile(const std::string& url, std::string* to, const bfs::path& pa
 
     // curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 1L);
 
-    if(ok)
-        ok = curl_easy_perform(curl_handle) == 0;
-
-    curl_easy_cleanup(curl_handle);
-
-    if(!path.empty())
+    // Overloaded servers answer with 429 or 503 before sending any data, so the request can be repeated.
+    // Other transient failures are repeated behind the data received so far
+    const unsigned maxAttempts = std::max(1u, getTransferSettings().maxAttempts);
+    std::string currentRange = range;
+    bool ok = false;
+    long responseCode = 0;
+    for(unsigned attempt = 1;; attempt++)
     {
-        if(tofp)
-            fclose(tofp);
+        const uint64_t numReceived = resumableSink.getNumReceived();
+        if(numReceived > 0 && range.empty())
+            curl_easy_setopt(curl_handle, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(numReceived));
+        if(!currentRange.empty())
+            curl_easy_setopt(curl_handle, CURLOPT_RANGE, currentRange.c_str()); //-V111
+        resumableSink.beginRequest(numReceived > 0 || !range.empty());
+
+        getServerBackoff().wait();
+        const CURLcode result = curl_easy_perform(curl_handle);
+        ok = result == CURLE_OK;
+        curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &responseCode);
         if(ok)
-            rename(tmpPath, path);
+            break;
+        if(resumableSink.getNumReceived() > numReceived)
+            attempt = 1;
+        if(attempt >= maxAttempts)
+            break;
+        if(responseCode == 429 || responseCode == 503)
+        {
+            boost::optional<std::chrono::seconds> retryAfter;
+#if CURL_AT_LEAST_VERSION(7, 66, 00)
+            curl_off_t retryAfterSeconds = 0;
+            curl_easy_getinfo(curl_handle, CURLINFO_RETRY_AFTER, &retryAfterSeconds);
+            if(retryAfterSeconds > 0)
+                retryAfter = std::chrono::seconds(retryAfterSeconds);
+#endif
+            const auto delay = getServerBackoff().onOverload(retryAfter);
+            if(progress)
+                bnw::cout << std::endl;
+            bnw::cout << "Server is busy, retrying in " << delay.count() << "s" << std::endl;
+        } else if(isTransientError(result, responseCode))
+        {
+            if(!range.empty())
+            {
+                const auto remainingRange = advanceRange(range, resumableSink.getNumReceived());
+                if(!remainingRange)
+                    break;
+                currentRange = *remainingRange;
+            }
+            const std::chrono::seconds delay(1 << std::min(attempt - 1, 5u));
+            if(progress)
+                bnw::cout << std::endl;
+            bnw::cout << "Transfer of " << url << " failed (" << curl_easy_strerror(result) << "), retrying in "
+                      << delay.count() << "s" << std::endl;
+            std::this_thread::sleep_for(delay);
+        } else
+            break;
+    }
+    if(ok)
+    {
+        getServerBackoff().onSuccess();
+#if CURL_AT_LEAST_VERSION(7, 61, 00)
+        curl_off_t bytes = 0, totalTime = 0, startTime = 0;
+        curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+        curl_easy_getinfo(curl_handle, CURLINFO_TOTAL_TIME_T, &totalTime);
+        curl_easy_getinfo(curl_handle, CURLINFO_STARTTRANSFER_TIME_T, &startTime);
+        getStrategyPlanner().addTransfer(static_cast<uint64_t>(bytes), totalTime / 1e6, startTime / 1e6);
+#endif
     }
 
-    return ok;
+    // Servers may ignore the range and send the whole file
+    if(ok && !range.empty())
+        ok = responseCode == 206;
+
+    return ok && sink.finish();
 }
 
 bool DownloadFile(const std::string& url, const bfs::path& path, std::string progress = "")
 {
-    return DoDownloadFile(url, nullptr, path, &progress);
+    StagedFile stagedFile(path);
+    bnw::ofstream file(stagedFile.getPath(), std::ios::binary);
+    if(!file)
+    {
+        bnw::cerr << "Can't open file \"" << path << "\"!!!!" << std::endl;
+        return false;
+    }
+    sink::Throttle<sink::StreamWriter> writer(stagedFile.getPath(), file);
+    bool ok = DoDownloadFile(url, writer, &progress);
+    file.close();
+    if(ok && !file)
+        ok = false;
+    if(ok)
+        stagedFile.commit();
+    return ok;
 }
 
 boost::optional<std::string> DownloadFile(const std::string& url)
 {
     std::string tmp;
-    if(DoDownloadFile(url, &tmp))
+    sink::MemoryWriter writer(tmp);
+    if(DoDownloadFile(url, writer))
         return tmp;
     else
         return boost::none;
 }
 
-/**
- *  calculate md5sum for a file
- */
-std::string md5sum(const std::string& file)
+boost::optional<std::string> DownloadRange(const std::string& url, const std::string& range)
 {
-    std::string digest;
+    std::string tmp;
+    sink::MemoryWriter writer(tmp);
+    if(DoDownloadFile(url, writer, nullptr, range))
+        return tmp;
+    else
+        return boost::none;
+}
+
+boost::optional<std::string> DownloadRange(const std::string& url, uint64_t offset, uint64_t length)
+{
+    auto result = DownloadRange(url, std::to_string(offset) + "-" + std::to_string(offset + length - 1));
+    if(result && result->size() != length)
+        return boost::none;
+    return result;
+}
+
+/// Get the frames of a seekable payload by downloading only its seek table
+boost::optional<std::vector<seekable::Frame>> DownloadSeekTable(const std::string& payloadUrl)
+{
+    const auto footer = DownloadRange(payloadUrl, "-" + std::to_string(seekable::footerSize));
+    const uint64_t seekTableSize = footer ? seekable::getSeekTableSize(*footer) : 0;
+    if(seekTableSize == 0)
+        return boost::none;
+    const auto seekTable = DownloadRange(payloadUrl, "-" + std::to_string(seekTableSize));
+    if(!seekTable || seekTable->size() != seekTableSize)
+        return boost::none;
+    try
+    {
+        return seekable::parseSeekTable(*seekTable);
+    } catch(const std::runtime_error&)
+    {
+        return boost::none;
+    }
+}
 
-    FILE* fp = boost::nowide::fopen(file.c_str(), "rb");
-    if(fp)
+/// Download a byte range of the decompressed file by fetching and decompressing only the frames containing it
+boost::optional<std::string> DownloadSeekableRange(const std::string& payloadUrl,
+                                                   const std::vector<seekable::Frame>& frames, uint64_t offset,
+                                                   uint64_t length)
+{
+    if(frames.empty() || offset + length > frames.back().decompressedOffset + frames.back().decompressedSize)
+        return boost::none;
+    const auto frameRange = seekable::findFrames(frames, offset, length);
+    const seekable::Frame& firstFrame = frames[frameRange.first];
+    const seekable::Frame& lastFrame = frames[frameRange.second];
+    const auto compressed = DownloadRange(payloadUrl, firstFrame.compressedOffset,
+                                          lastFrame.compressedOffset + lastFrame.compressedSize
+                                            - firstFrame.compressedOffset);
+    if(!compressed)
+        return boost::none;
+    const uint64_t decompressedSize =
+      lastFrame.decompressedOffset + lastFrame.decompressedSize - firstFrame.decompressedOffset;
+    MemoryBudget::Lease lease(getMemoryBudget(), compressed->size() + decompressedSize + lastFrame.decompressedSize);
+    std::string result, decompressed;
+    result.reserve(static_cast<size_t>(decompressedSize));
+    for(size_t i = frameRange.first; i <= frameRange.second; i++)
     {
-        md5file(fp, digest);
-        fclose(fp);
+        const char* frameData = compressed->data() + (frames[i].compressedOffset - firstFrame.compressedOffset);
+        if(!seekable::decompressFrame(frameData, frames[i], decompressed))
+            return boost::none;
+        result += decompressed;
     }
-    return digest;
+    return result.substr(static_cast<size_t>(offset - firstFrame.decompressedOffset), static_cast<size_t>(length));
 }
 
 #ifdef _WIN32
@@ -324,10 +707,11 @@ bool ValidateSavegameVersion(const std::string& httpbase, const bfs::path& saveg
     }
 }
 
-bool isCurrentDirWritable()
+bool isDirWritable(const bfs::path& dir)
 {
+    const bfs::path testFilePath = dir / "write.test";
 #ifdef _WIN32
-    HANDLE hFile = CreateFileW(L"write.test", GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    HANDLE hFile = CreateFileW(testFilePath.wstring().c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
     if(hFile == INVALID_HANDLE_VALUE)
     {
         if(GetLastError() != ERROR_ACCESS_DENIED)
@@ -336,15 +720,15 @@ bool isCurrentDirWritable()
     } else
     {
         CloseHandle(hFile);
-        DeleteFileW(L"write.test");
+        DeleteFileW(testFilePath.wstring().c_str());
         return true;
     }
 #else
-    bnw::ofstream testFile("write.test", bnw::ofstream::trunc);
+    bnw::ofstream testFile(testFilePath, bnw::ofstream::trunc);
     if(testFile)
     {
         testFile.close();
-        bfs::remove("write.test");
+        bfs::remove(testFilePath);
         return true;
     } else
         return false;
@@ -382,23 +766,28 @@ bool runAsAdmin(int argc, char* argv[])
 auto parseFileList(const std::string& filelistFileContents)
 {
     std::vector<std::pair<std::string, std::string>> files;
-    std::stringstream flstream(filelistFileContents);
+    // Parsed in place, as the list of a large installation has millions of lines
+    files.reserve(std::count(filelistFileContents.begin(), filelistFileContents.end(), '\n') + 1);
 
-    std::string line;
-    while(getline(flstream, line))
+    for(size_t lineStart = 0; lineStart < filelistFileContents.size();)
     {
-        if(line.empty())
+        size_t lineEnd = filelistFileContents.find('\n', lineStart);
+        if(lineEnd == std::string::npos)
+            lineEnd = filelistFileContents.size();
+        if(lineEnd == lineStart)
             break;
 
-        if(line.substr(32, 2) != "  ")
-            throw std::runtime_error("Invalid line in filelist: " + line);
-        std::string hash = line.substr(0, 32);
-        std::string file = line.substr(34);
-
-        files.emplace_back(std::move(hash), std::move(file));
-
-        if(flstream.fail())
-            break;
+        // Format: <hash>  <filePath> with a MD5 (v1) or BLAKE3 (v2) hex digest
+        const size_t separatorPos = filelistFileContents.find("  ", lineStart);
+        const size_t hashLen = separatorPos < lineEnd ? separatorPos - lineStart : 0;
+        if(hashLen != getDigestLength(HashAlgorithm::MD5) && hashLen != getDigestLength(HashAlgorithm::BLAKE3))
+        {
+            throw std::runtime_error("Invalid line in filelist: "
+                                     + filelistFileContents.substr(lineStart, lineEnd - lineStart));
+        }
+        files.emplace_back(filelistFileContents.substr(lineStart, hashLen),
+                           filelistFileContents.substr(lineStart + hashLen + 2, lineEnd - lineStart - hashLen - 2));
+        lineStart = lineEnd + 1;
     }
     return files;
 }
@@ -425,93 +814,234 @@ auto parseLinkList(const std::string& linkFileContents)
     return links;
 }
 
-void updateFile(const std::string& httpBase, const std::string& origFilePath, const bool verbose)
+/// A file which needs to be updated
+struct OutdatedFile
 {
-    const bfs::path filepath = bfs::path(origFilePath).make_preferred();
-    const bfs::path name = filepath.filename();
-    const bfs::path path = filepath.parent_path();
-    bfs::path bzfile = filepath;
-    bzfile += ".bz2";
+    std::string path;
+    /// Hash from the file list
+    std::string hash;
+    FileMetadata metadata;
+    /// If not empty only these chunks need to be replaced
+    std::vector<size_t> corruptChunks;
+    /// Digest of the current file if it was calculated
+    std::string digest;
+};
 
-    bnw::cout << "Updating " << name;
-    if(verbose)
-        bnw::cout << " to " << path;
-    bnw::cout << std::endl;
+/// Create the directories required for the given files of the installation in workPath in one pass.
+/// Only files whose directory is missing need to be passed. Parents are created before their children
+void createDirectories(const bfs::path& workPath, const std::vector<std::string_view>& filePaths)
+{
+    // Sorted such that each directory comes after its parent
+    std::set<bfs::path> directories;
+    for(const std::string_view filePath : filePaths)
+    {
+        for(bfs::path dir = bfs::path(filePath.begin(), filePath.end()).make_preferred().parent_path(); !dir.empty();
+            dir = dir.parent_path())
+        {
+            if(!directories.insert(dir).second)
+                break;
+        }
+    }
 
-    // create path of file
-    if(!bfs::is_directory(path))
+    for(const auto& dir : directories)
     {
         boost::system::error_code ec;
-        bfs::create_directories(path, ec);
+        bfs::create_directory(workPath / dir, ec);
         if(ec)
         {
             std::stringstream msg;
-            msg << "Failed to create directories to path " << path << " for " << name << ": " << ec.message()
-                << std::endl;
+            msg << "Failed to create directory " << dir << ": " << ec.message() << std::endl;
             throw std::runtime_error(msg.str());
         }
     }
+}
+
+/// Get the path of a file from the file list in the installation in workPath
+bfs::path getLocalPath(const bfs::path& workPath, const std::string& origFilePath)
+{
+    return (workPath / origFilePath).lexically_normal().make_preferred();
+}
 
+/// Get the url of the uncompressed file
+std::string getFileUrl(const std::string& httpBase, const std::string& origFilePath)
+{
+    const bfs::path filePath(origFilePath);
+    return httpBase + "/" + filePath.parent_path().string() + "/" + EscapeFile(filePath.filename().string());
+}
+
+/// Get the prefix of the progress bar for downloading the file
+std::string getDownloadProgress(const bfs::path& name)
+{
     std::stringstream progress;
     progress << "Downloading " << name;
     while(progress.str().size() < 50)
         progress << " ";
+    return progress.str();
+}
 
-    std::stringstream url;
-    url << httpBase << "/" << bfs::path(origFilePath).parent_path().string() << "/" << EscapeFile(name.string())
-        << ".bz2";
-
+/// Download the compressed version of the file to payloadPath, which determines the format by its extension
+bool downloadPayload(const std::string& httpBase, const std::string& origFilePath, const bfs::path& payloadPath)
+{
     // download the file
-    bool dlOk = DownloadFile(url.str(), bzfile, progress.str());
+    bool dlOk = DownloadFile(getFileUrl(httpBase, origFilePath) + payloadPath.extension().string(), payloadPath,
+                             getDownloadProgress(payloadPath.stem()));
 
+    bnw::cout << " - ";
+    return dlOk;
+}
+
+/// Download the bzip2 payload of the file and decompress it to the output file while it is received.
+/// Return the digest of the decompressed data or none if the download failed
+template<class T_Hash>
+boost::optional<std::string> streamPayload(const std::string& httpBase, const std::string& origFilePath,
+                                           const bfs::path& outputPath, bnw::ofstream& outputFile)
+{
+    sink::Bz2Decompress<sink::HashTee<T_Hash, sink::Throttle<sink::StreamWriter>>> pipeline(outputPath, outputFile);
+    std::string progress = getDownloadProgress(bfs::path(origFilePath).filename());
+    const bool dlOk = DoDownloadFile(getFileUrl(httpBase, origFilePath) + ".bz2", pipeline, &progress);
     bnw::cout << " - ";
     if(!dlOk)
-    {
-        bnw::cout << "failed!" << std::endl;
-        throw std::runtime_error("Download of " + bzfile.string() + "failed!");
-    }
+        return boost::none;
+    getStrategyPlanner().addCompression(pipeline.getCompressedSize(), pipeline.getDecompressedSize());
+    return pipeline.next().getDigest();
+}
 
-    // extract the file
-    int bzerror = BZ_OK;
-    FILE* bzfp = boost::nowide::fopen(bzfile.string().c_str(), "rb");
-    if(!bzfp)
+/// Decompress a bzip2 payload to the output file and return the digest of the decompressed data
+template<class T_Hash>
+std::string extractPayload(const bfs::path& bzfile, const bfs::path& outputPath, bnw::ofstream& outputFile)
+{
+    bnw::ifstream input(bzfile, std::ios::binary);
+    if(!input)
         throw std::runtime_error("decompression failed: download failure?");
 
-    bzerror = BZ_OK;
-    BZFILE* bz2fp = BZ2_bzReadOpen(&bzerror, bzfp, 0, 0, nullptr, 0);
-    if(!bz2fp)
+    sink::Bz2Decompress<sink::HashTee<T_Hash, sink::Throttle<sink::StreamWriter>>> pipeline(outputPath, outputFile);
+    const auto inputBuffer = getIoBufferPool().acquire();
+    MemoryBudget::Lease lease(getMemoryBudget(), inputBuffer->size());
+    const auto startTime = std::chrono::steady_clock::now();
+    bool ok = true;
+    while(ok && input.read(inputBuffer->data(), inputBuffer->size()).gcount() > 0)
+        ok = pipeline.write(inputBuffer->data(), static_cast<size_t>(input.gcount()));
+    if(!ok || !pipeline.finish())
         throw std::runtime_error("decompression failed: compressed file corrupt?");
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+    getStrategyPlanner().addDecompression(pipeline.getDecompressedSize(), duration.count());
+    getStrategyPlanner().addCompression(pipeline.getCompressedSize(), pipeline.getDecompressedSize());
+    return pipeline.next().getDigest();
+}
 
-    bnw::ofstream outputFile(filepath, bnw::ofstream::binary | bnw::ofstream::trunc);
-    if(!outputFile)
+/// Download and extract a single file of the installation in workPath. The directory of the file must already exist.
+/// Completed steps are recorded in the journal and steps recorded by an interrupted run are skipped.
+/// If trySeekable is set, a seekable payload is tried first which is decompressed in parallel.
+/// Otherwise the payload is decompressed while downloading. The extracted file is checked against the hash and
+/// its digest is added to the hash cache if given
+void updateFile(const std::string& httpBase, const bfs::path& workPath, const std::string& origFilePath,
+                const std::string& hash, const bool verbose, UpdateJournal* journal = nullptr,
+                HashCache* hashCache = nullptr, const bool trySeekable = false)
+{
+    const bfs::path filepath = getLocalPath(workPath, origFilePath);
+    const bfs::path name = filepath.filename();
+    const bfs::path path = filepath.parent_path();
+    bfs::path bzfile = filepath;
+    bzfile += ".bz2";
+    bfs::path bzsfile = filepath;
+    bzsfile += ".bzs";
+
+    bnw::cout << "Updating " << name;
+    if(verbose)
+        bnw::cout << " to " << path;
+    bnw::cout << std::endl;
+
+    const auto lastStep = journal ? journal->getStep(origFilePath) : boost::none;
+    if(lastStep == JournalStep::Extracted)
     {
-        bfs::path bakFilePath(filepath);
-        bakFilePath += ".bak";
-        boost::system::error_code error;
-        bfs::rename(filepath, bakFilePath, error);
-        // move file out of the way ...
-        if(error)
-            throw std::runtime_error("failed to move blocked file " + filepath.string() + " out of the way ...");
-        outputFile.open(filepath, bnw::ofstream::binary | bnw::ofstream::trunc);
+        // Only the cleanup is missing
+        bfs::remove(bzfile);
+        bfs::remove(bzsfile);
+        journal->record(origFilePath, JournalStep::Committed);
+        return;
     }
+    bool isSeekable = false;
+    bool isDownloaded = false;
+    if(lastStep == JournalStep::Downloaded && (bfs::exists(bzsfile) || bfs::exists(bzfile)))
+    {
+        isSeekable = bfs::exists(bzsfile);
+        isDownloaded = true;
+        if(verbose)
+            bnw::cout << "Using previously downloaded " << (isSeekable ? bzsfile : bzfile) << std::endl;
+    } else if(trySeekable && downloadPayload(httpBase, origFilePath, bzsfile))
+    {
+        isSeekable = isDownloaded = true;
+        if(journal)
+            journal->record(origFilePath, JournalStep::Downloaded);
+    }
+
+    // extract the file. The old file is only replaced once the new one is complete and verified
+    const bool isBlake3 = getHashAlgorithm(hash) == HashAlgorithm::BLAKE3;
+    boost::optional<std::string> digest;
+    StagedFile stagedFile(filepath);
+    bnw::ofstream outputFile(stagedFile.getPath(), std::ios::binary);
     if(!outputFile)
         throw std::runtime_error("Failed to open output file " + filepath.string());
-
-    while(bzerror == BZ_OK)
+    if(isSeekable)
+    {
+        const auto frames = seekable::readSeekTable(bzsfile);
+        outputFile.close();
+        if(!frames.empty())
+            bfs::resize_file(stagedFile.getPath(), frames.back().decompressedOffset + frames.back().decompressedSize);
+        const auto startTime = std::chrono::steady_clock::now();
+        if(!seekable::decompressFile(bzsfile, frames, stagedFile.getPath(), getExecutor()))
+            throw std::runtime_error("decompression failed: compressed file corrupt?");
+        if(!frames.empty())
+        {
+            const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+            const uint64_t decompressedSize = frames.back().decompressedOffset + frames.back().decompressedSize;
+            const unsigned numThreads = std::min<unsigned>(getExecutor().getNumThreads(), frames.size());
+            getStrategyPlanner().addDecompression(decompressedSize, duration.count() * numThreads);
+            getStrategyPlanner().addCompression(frames.back().compressedOffset + frames.back().compressedSize,
+                                                decompressedSize);
+        }
+        // The frames are decompressed in parallel, so the result is hashed afterwards
+        digest = hashFile(stagedFile.getPath().string(), getHashAlgorithm(hash));
+    } else if(isDownloaded)
+    {
+        digest = isBlake3 ? extractPayload<Blake3>(bzfile, stagedFile.getPath(), outputFile) :
+                            extractPayload<Md5Hash>(bzfile, stagedFile.getPath(), outputFile);
+    } else
+    {
+        digest = isBlake3 ? streamPayload<Blake3>(httpBase, origFilePath, stagedFile.getPath(), outputFile) :
+                            streamPayload<Md5Hash>(httpBase, origFilePath, stagedFile.getPath(), outputFile);
+        if(!digest)
+        {
+            bnw::cout << "failed!" << std::endl;
+            throw std::runtime_error("Download of " + bzfile.string() + "failed!");
+        }
+    }
+    if(*digest != hash)
     {
-        std::array<char, 1024> buffer;
-        unsigned read = BZ2_bzRead(&bzerror, bz2fp, buffer.data(), static_cast<int>(buffer.size()));
-        if(!outputFile.write(buffer.data(), read))
-            bnw::cerr << "failed to write to disk" << std::endl;
+        bnw::cout << "failed!" << std::endl;
+        // Don't resume from the corrupt payload
+        if(isDownloaded)
+            bfs::remove(isSeekable ? bzsfile : bzfile);
+        throw std::runtime_error("Checksum mismatch of " + filepath.string());
     }
 
+    outputFile.close();
+    if(!isSeekable && !outputFile)
+        throw std::runtime_error("Failed to write " + filepath.string());
+    stagedFile.commit();
+
     bnw::cout << "ok";
 
-    BZ2_bzReadClose(&bzerror, bz2fp);
-    fclose(bzfp);
+    if(journal)
+        journal->record(origFilePath, JournalStep::Extracted);
+    if(hashCache)
+        hashCache->update(filepath.string(), statFile(filepath.string()), *digest);
 
     // remove compressed file
-    bfs::remove(bzfile);
+    if(isDownloaded)
+        bfs::remove(isSeekable ? bzsfile : bzfile);
+    if(journal)
+        journal->record(origFilePath, JournalStep::Committed);
 
     bnw::cout << std::endl;
 
@@ -521,6 +1051,145 @@ void updateFile(const std::string& httpBase, const std::string& origFilePath, co
 #endif // !_WIN32
 }
 
+/// Download the patch and apply it to the current version of the file while it is received.
+/// Return the digest of the new contents or none if that failed
+template<class T_Hash>
+boost::optional<std::string> streamPatch(const std::string& patchUrl, const bfs::path& oldFilePath,
+                                         const bfs::path& outputPath, bnw::ofstream& outputFile)
+{
+    sink::Bz2Decompress<sink::DeltaApply<sink::HashTee<T_Hash, sink::Throttle<sink::StreamWriter>>>> pipeline(
+      oldFilePath, outputPath, outputFile);
+    std::string progress = getDownloadProgress(oldFilePath.filename());
+    const bool dlOk = DoDownloadFile(patchUrl, pipeline, &progress);
+    bnw::cout << " - ";
+    if(!dlOk)
+        return boost::none;
+    return pipeline.next().next().getDigest();
+}
+
+/// Update the file of the installation in workPath by a patch from its current version.
+/// Return false if that failed and the file needs to be downloaded
+bool applyPatch(const std::string& httpBase, const bfs::path& workPath, const std::string& origFilePath,
+                const std::string& hash, const delta::IndexEntry& patch, HashCache* hashCache = nullptr)
+{
+    const bfs::path filepath = getLocalPath(workPath, origFilePath);
+    bnw::cout << "Patching " << filepath.filename() << std::endl;
+    boost::optional<std::string> digest;
+    // The current file is read while the new version is staged
+    StagedFile stagedFile(filepath);
+    {
+        bnw::ofstream outputFile(stagedFile.getPath(), std::ios::binary);
+        if(!outputFile)
+            return false;
+        const std::string patchUrl = getFileUrl(httpBase, patch.path);
+        digest = getHashAlgorithm(hash) == HashAlgorithm::BLAKE3 ?
+                   streamPatch<Blake3>(patchUrl, filepath, stagedFile.getPath(), outputFile) :
+                   streamPatch<Md5Hash>(patchUrl, filepath, stagedFile.getPath(), outputFile);
+        outputFile.close();
+        if(!outputFile)
+            digest = boost::none;
+    }
+    if(!digest || *digest != hash)
+    {
+        bnw::cout << "failed, updating the whole file" << std::endl;
+        return false;
+    }
+    stagedFile.commit();
+    bnw::cout << "ok" << std::endl;
+    if(hashCache)
+        hashCache->update(filepath.string(), statFile(filepath.string()), *digest);
+    return true;
+}
+
+/// Replace only the corrupt chunks of the file by requesting their byte ranges from the server.
+/// Return false if that failed and the whole file needs to be updated
+bool repairChunks(const std::string& httpBase, const bfs::path& workPath, const std::string& origFilePath,
+                  const ChunkList& chunks, const std::vector<size_t>& corruptChunks)
+{
+    const std::string filePath = getLocalPath(workPath, origFilePath).string();
+    // Shared files can't be modified in place
+    boost::system::error_code ec;
+    if(bfs::hard_link_count(filePath, ec) > 1)
+        return false;
+    bnw::cout << "Repairing " << corruptChunks.size() << " of " << chunks.chunkHashes.size() << " chunks of "
+              << bfs::path(filePath).filename() << std::endl;
+    const std::string url = getFileUrl(httpBase, origFilePath);
+    // Prefer fetching only the required frames of the seekable payload over the uncompressed file
+    const auto frames = DownloadSeekTable(url + ".bzs");
+    // Request consecutive chunks at once, but keep the ranges small enough to respect the memory budget
+    const uint64_t memoryLimit = getMemoryBudget().getLimit();
+    const uint64_t maxRangeChunks = memoryLimit == 0 ? corruptChunks.size() : memoryLimit / 4 / chunks.chunkSize;
+    for(auto itFirst = corruptChunks.begin(); itFirst != corruptChunks.end();)
+    {
+        auto itLast = itFirst;
+        while(std::next(itLast) != corruptChunks.end() && *std::next(itLast) == *itLast + 1
+              && static_cast<uint64_t>(std::next(itLast) - itFirst) < maxRangeChunks)
+            ++itLast;
+        const uint64_t offset = chunks.getChunkOffset(*itFirst);
+        const uint64_t length = chunks.getChunkOffset(*itLast) + chunks.getChunkLength(*itLast) - offset;
+        const auto data =
+          frames ? DownloadSeekableRange(url + ".bzs", *frames, offset, length) : DownloadRange(url, offset, length);
+        if(!data)
+        {
+            bnw::cout << "Download of chunks failed, updating the whole file" << std::endl;
+            return false;
+        }
+        for(auto it = itFirst; it != std::next(itLast); ++it)
+        {
+            const std::string chunk = data->substr(chunks.getChunkOffset(*it) - offset, chunks.getChunkLength(*it));
+            getWriteThrottle().acquire(chunk.size());
+            if(md5string(chunk) != chunks.chunkHashes[*it] || !writeChunk(filePath, chunks, *it, chunk))
+            {
+                bnw::cout << "Repair of chunk " << *it << " failed, updating the whole file" << std::endl;
+                return false;
+            }
+        }
+        itFirst = std::next(itLast);
+    }
+    return true;
+}
+
+/// Check if the file matches the hash. The cached digest is used if the file is unchanged.
+/// Matching files are added to the cache.
+/// If chunk hashes are given, chunks are verified in parallel and the corrupt ones returned in corruptChunks.
+/// If all chunks match the whole file is still hashed before it counts as up to date.
+/// The digest of an outdated file is returned in currentDigest if it was calculated
+bool isUpToDate(const std::string& hash, const std::string& filePath, const FileMetadata& metadata,
+                HashCache& hashCache, const bool useHashCache, const ChunkList* chunks = nullptr,
+                std::vector<size_t>* corruptChunks = nullptr, std::string* currentDigest = nullptr)
+{
+    // Missing files don't need to be hashed
+    if(!metadata.exists)
+        return false;
+    boost::optional<std::string> digest;
+    if(useHashCache)
+        digest = hashCache.lookup(filePath, metadata);
+    // The cached digest might have been calculated for another file list version
+    if(digest && digest->size() != hash.size())
+        digest = boost::none;
+    if(!digest && chunks && metadata.size == chunks->fileSize)
+    {
+        auto corrupt = findCorruptChunks(filePath, *chunks, getExecutor());
+        if(!corrupt.empty())
+        {
+            if(corruptChunks)
+                *corruptChunks = std::move(corrupt);
+            return false;
+        }
+        // Matching chunks only mean the file matches the chunk list which might not belong to this file list
+    }
+    if(!digest)
+        digest = hashFile(filePath, getHashAlgorithm(hash));
+    if(hash != *digest)
+    {
+        if(currentDigest)
+            *currentDigest = *digest;
+        return false;
+    }
+    hashCache.update(filePath, metadata, hash);
+    return true;
+}
+
 /// Copy srcFile to destination or create a symlink at dst pointing to src
 void copyOrSymlink(const bfs::path& srcFileName, const bfs::path& dstFilepath)
 {
@@ -552,16 +1221,17 @@ void copyOrSymlink(const bfs::path& srcFileName, const bfs::path& dstFilepath)
 #endif
 }
 
-auto getPossibleHttpBases(const bool nightly)
+/// Get the update urls for the platform (<target>.<arch>), newest first
+auto getPossibleHttpBases(const bool nightly, const std::string& platform)
 {
-    std::string base = HTTPHOST;
+    std::string base = getTransferSettings().server;
     if(nightly)
         base += NIGHTLYPATH;
     else
         base += STABLEPATH;
 
     std::stringstream url;
-    url << base << TARGET << "." << ARCH;
+    url << base << platform;
     const auto archBase = url.str();
     std::vector<std::string> bases = {archBase + FILEPATH};
     for(int i = 1; i <= 5; i++)
@@ -573,11 +1243,613 @@ auto getPossibleHttpBases(const bool nightly)
     return bases;
 }
 
+/// Update information of a channel downloaded from the server, shared by all installations using the channel
+struct Channel
+{
+    /// Includes target path and file path
+    std::string httpBase;
+    std::string fileList;
+    std::vector<std::pair<std::string, std::string>> files;
+    std::vector<std::pair<std::string, std::string>> links;
+    std::unordered_map<std::string, ChunkList> chunkLists;
+    std::vector<SmallFilePack> packs;
+    delta::Index deltas;
+};
+
+Channel fetchChannel(const bool nightly, const std::string& platform, const bool verbose)
+{
+    Channel channel;
+
+    // download filelist
+    if(verbose)
+        bnw::cout << "Requesting current version information for " << platform << " from server..." << std::endl;
+    const auto possibleBases = getPossibleHttpBases(nightly, platform);
+    for(size_t i = 0; i < possibleBases.size(); i++)
+    {
+        // Prefer the BLAKE3 file list which can be verified much faster, older builds only have the MD5 one
+        auto filelistOpt = DownloadFile(possibleBases[i] + FILELISTV2);
+        if(!filelistOpt)
+            filelistOpt = DownloadFile(possibleBases[i] + FILELIST);
+        if(!filelistOpt)
+            bnw::cout << "Warning: Was not able to get masterfile " << i << ", trying older one" << std::endl;
+        else
+        {
+            channel.fileList = std::move(*filelistOpt);
+            channel.httpBase = possibleBases[i];
+            break;
+        }
+    }
+    if(channel.fileList.empty())
+        throw std::runtime_error("Could not get any master file");
+
+    // download linklist
+    const auto linklist = DownloadFile(channel.httpBase + LINKLIST);
+    if(!linklist)
+        bnw::cout << "Warning: Was not able to get linkfile, ignoring" << std::endl;
+
+    if(verbose)
+        bnw::cout << "Parsing update list..." << std::endl;
+
+    const auto parseStartTime = PhaseTimes::Clock::now();
+    channel.files = parseFileList(channel.fileList);
+    if(linklist)
+        channel.links = parseLinkList(*linklist);
+    getPhaseTimes().add("parsing", PhaseTimes::Clock::now() - parseStartTime);
+
+    // download optional chunk hashes of large files
+    if(const auto chunklist = DownloadFile(channel.httpBase + CHUNKLIST))
+        channel.chunkLists = parseChunkList(*chunklist);
+    // download optional packs of small files
+    if(const auto packlist = DownloadFile(channel.httpBase + PACKLIST))
+        channel.packs = parsePackList(*packlist);
+    // download optional index of patches from earlier versions
+    if(const auto deltalist = DownloadFile(channel.httpBase + DELTALIST))
+        channel.deltas = delta::parseIndex(*deltalist);
+    return channel;
+}
+
+/// An installation to update
+struct Installation
+{
+    bfs::path workPath;
+    const Channel* channel;
+    /// Metadata of all files of the channel, queried at once and used by all following stages
+    std::vector<FileMetadata> metadata;
+    /// Digests of files which did not change since the last run
+    HashCache hashCache;
+    /// Progress of an interrupted run of the same update
+    UpdateJournal journal;
+    /// If set, workPath is the slot of the build which is activated after the update
+    std::unique_ptr<SlotLayout> slotLayout;
+    std::string slotId;
+
+    Installation(bfs::path workPath, const Channel& channel)
+        : workPath(std::move(workPath)), channel(&channel), hashCache(this->workPath / HASHCACHE),
+          journal(this->workPath / JOURNAL, md5string(channel.fileList))
+    {}
+};
+
+/// Check a single file of the installation. Return the file if it needs to be updated
+std::unique_ptr<OutdatedFile> verifyFile(Installation& installation, const size_t idx, const bool useHashCache)
+{
+    const std::string& hash = installation.channel->files[idx].first;
+    const std::string& origFilePath = installation.channel->files[idx].second;
+    const auto& chunkLists = installation.channel->chunkLists;
+
+    const auto lastStep = installation.journal.getStep(origFilePath);
+    if(lastStep == JournalStep::Committed)
+    {
+        // Only entries passed to the cache again are saved, so keep the one of the interrupted run
+        const std::string filePath = getLocalPath(installation.workPath, origFilePath).string();
+        if(const auto digest = installation.hashCache.lookup(filePath, installation.metadata[idx]))
+            installation.hashCache.update(filePath, installation.metadata[idx], *digest);
+        return nullptr;
+    }
+    const auto itChunks = chunkLists.find(origFilePath);
+    const ChunkList* chunks = itChunks == chunkLists.end() ? nullptr : &itChunks->second;
+    std::vector<size_t> corruptChunks;
+    std::string digest;
+    // Partially updated files are known to be outdated
+    if(!lastStep
+       && isUpToDate(hash, getLocalPath(installation.workPath, origFilePath).string(), installation.metadata[idx],
+                     installation.hashCache, useHashCache, chunks, &corruptChunks, &digest))
+        return nullptr;
+    return std::make_unique<OutdatedFile>(
+      OutdatedFile{origFilePath, hash, installation.metadata[idx], std::move(corruptChunks), std::move(digest)});
+}
+
+/// Result of verifying a single file, handed from the verification tasks to the updating thread
+struct VerifiedFile
+{
+    size_t installationIdx = 0;
+    size_t fileIdx = 0;
+    /// Set if the file needs to be updated. Not stored inline to keep the queue small
+    std::unique_ptr<OutdatedFile> outdatedFile;
+    std::exception_ptr error;
+    PhaseTimes::Clock::time_point finishTime;
+};
+
+/// Hands the results of the verification tasks to the updating thread without ever blocking a task, as a blocked
+/// worker could not run the nested tasks of other files. Results which don't fit into the ring queue, e.g. while the
+/// updating thread downloads a large file, are kept in an overflow list
+class VerifiedFileHandoff
+{
+public:
+    VerifiedFileHandoff() : queue_(queueCapacity) {}
+
+    void push(VerifiedFile result)
+    {
+        if(queue_.tryPush(result))
+            return;
+        std::lock_guard<std::mutex> lock(overflowMutex_);
+        overflow_.push_back(std::move(result));
+        // The updating thread might have emptied the queue and wait for it since it looked at the overflow list
+        while(!overflow_.empty() && queue_.tryPush(overflow_.back()))
+            overflow_.pop_back();
+    }
+
+    /// Move up to maxCount results to items, waiting for at least one. Only one thread may pop
+    size_t pop(VerifiedFile* items, const size_t maxCount)
+    {
+        size_t count = queue_.popBatch(items, maxCount);
+        if(count > 0)
+            return count;
+        {
+            std::lock_guard<std::mutex> lock(overflowMutex_);
+            for(; count < maxCount && !overflow_.empty(); count++)
+            {
+                items[count] = std::move(overflow_.back());
+                overflow_.pop_back();
+            }
+        }
+        if(count == 0)
+        {
+            // Never closed, only called while results are expected
+            queue_.pop(items[0]);
+            count = 1;
+        }
+        return count;
+    }
+
+private:
+    static constexpr size_t queueCapacity = 1024;
+    ringQueue::MpmcQueue<VerifiedFile> queue_;
+    std::mutex overflowMutex_;
+    std::vector<VerifiedFile> overflow_;
+};
+
+/// Verify all files of all installations concurrently as tasks of the group and hand each result over
+void startVerification(const std::vector<std::unique_ptr<Installation>>& installations, const bool useHashCache,
+                       Executor::TaskGroup& group, VerifiedFileHandoff& handoff)
+{
+    for(size_t i = 0; i < installations.size(); i++)
+    {
+        for(size_t j = 0; j < installations[i]->channel->files.size(); j++)
+        {
+            group.run(
+              [&installations, &handoff, i, j, useHashCache]() {
+                  VerifiedFile result;
+                  result.installationIdx = i;
+                  result.fileIdx = j;
+                  try
+                  {
+                      result.outdatedFile = verifyFile(*installations[i], j, useHashCache);
+                  } catch(...)
+                  {
+                      result.error = std::current_exception();
+                  }
+                  result.finishTime = PhaseTimes::Clock::now();
+                  handoff.push(std::move(result));
+              },
+              Executor::Priority::Normal);
+        }
+    }
+}
+
+/// Try to copy a file already updated in another installation instead of downloading it again
+bool copyUpdatedFile(const bfs::path& srcFilePath, const bfs::path& dstFilePath, const bool verbose)
+{
+    constexpr auto overwrite_existing =
+#if BOOST_VERSION >= 107400
+      bfs::copy_options::overwrite_existing;
+#else
+      bfs::copy_option::overwrite_if_exists;
+#endif
+    boost::system::error_code ec;
+    const uintmax_t size = bfs::file_size(srcFilePath, ec);
+    if(ec)
+        return false;
+    const auto srcStatus = bfs::status(srcFilePath, ec);
+    if(ec)
+        return false;
+    // The copy is not split, so the whole file is accounted before
+    getWriteThrottle().acquire(size);
+    const auto startTime = std::chrono::steady_clock::now();
+    // Staged like all other updates, which also keeps files shared by hardlinks (e.g. with another slot) intact
+    StagedFile stagedFile(dstFilePath);
+    bfs::copy_file(srcFilePath, stagedFile.getPath(), overwrite_existing, ec);
+    if(ec)
+        return false;
+    bfs::permissions(stagedFile.getPath(), srcStatus.permissions(), ec);
+    try
+    {
+        stagedFile.commit();
+    } catch(const std::exception&)
+    {
+        return false;
+    }
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+    getStrategyPlanner().addCopy(size, duration.count());
+    bnw::cout << "Copied " << dstFilePath.filename();
+    if(verbose)
+        bnw::cout << " from " << srcFilePath;
+    bnw::cout << std::endl;
+    return true;
+}
+
+/// Update the file from the shared object cache or download it and add it to the cache.
+/// Only one process at a time downloads a file, others wait for it and take it from the cache
+void updateFileCached(const ObjectCache& objectCache, Installation& installation, const OutdatedFile& file,
+                      const bool trySeekable, const bool verbose)
+{
+    const Channel& channel = *installation.channel;
+    const bfs::path filePath = getLocalPath(installation.workPath, file.path);
+    const auto fetchCached = [&]() {
+        if(!objectCache.fetch(file.hash, filePath))
+            return false;
+        bnw::cout << "Reused cached " << filePath.filename() << std::endl;
+        installation.journal.record(file.path, JournalStep::Committed);
+        return true;
+    };
+    if(fetchCached())
+        return;
+    const auto lock = objectCache.lockProducer(file.hash);
+    if(!lock.isOwned())
+        bnw::cerr << "Warning: Ignoring stale lock of cached " << filePath.filename() << std::endl;
+    // Another process might have added it meanwhile
+    else if(fetchCached())
+        return;
+    updateFile(channel.httpBase, installation.workPath, file.path, file.hash, verbose, &installation.journal,
+               &installation.hashCache, trySeekable);
+    objectCache.store(file.hash, filePath);
+}
+
+/// Collect what is known about the file for choosing a strategy to update it
+FileUpdateInfo getUpdateInfo(const Channel& channel, const OutdatedFile& file, const bool hasLocalCopy,
+                             const bool hasPackEntry)
+{
+    FileUpdateInfo info;
+    const auto itChunks = channel.chunkLists.find(file.path);
+    const ChunkList* chunks = itChunks == channel.chunkLists.end() ? nullptr : &itChunks->second;
+    // The old file is the best guess for the size of the new one if nothing else is known
+    info.size = chunks ? chunks->fileSize : file.metadata.size;
+    info.hasLocalCopy = hasLocalCopy;
+    info.hasPackEntry = hasPackEntry;
+    const auto itDelta = channel.deltas.find(std::make_pair(file.digest, file.hash));
+    if(itDelta != channel.deltas.end())
+        info.deltaSize = itDelta->second.size;
+    // Seekable payloads are provided for files with chunk hashes
+    info.hasSeekablePayload = chunks != nullptr;
+    if(chunks)
+    {
+        for(size_t i = 0; i < file.corruptChunks.size(); i++)
+        {
+            info.repairBytes += chunks->getChunkLength(file.corruptChunks[i]);
+            if(i == 0 || file.corruptChunks[i] != file.corruptChunks[i - 1] + 1)
+                info.numRepairRanges++;
+        }
+    }
+    return info;
+}
+
+/// Update a single outdated file by the cheapest strategy: Copying it from another installation, repairing its
+/// chunks, patching it, extracting it from a pack or downloading it. If a strategy fails the next cheapest one is used.
+/// Throws if all of them failed. The directory of the file must already exist
+void updateOutdatedFile(Installation& installation, const OutdatedFile& file,
+                        std::unordered_map<std::string, bfs::path>& updatedFiles, const ObjectCache* objectCache,
+                        PackStore& packStore, const bool verbose)
+{
+    const Channel& channel = *installation.channel;
+    const auto itCopy = updatedFiles.find(file.hash);
+    const bfs::path filePath = getLocalPath(installation.workPath, file.path);
+    StrategyPlanner& planner = getStrategyPlanner();
+    const SmallFilePack* pack = packStore.find(file.hash);
+    const auto planStartTime = PhaseTimes::Clock::now();
+    const FileUpdateInfo info = getUpdateInfo(channel, file, itCopy != updatedFiles.end(), pack != nullptr);
+    const auto plan = planner.plan(info, getExecutor().getNumThreads());
+    getPhaseTimes().add("planning", PhaseTimes::Clock::now() - planStartTime);
+    bool updated = false;
+    for(const StrategyCost& cost : plan)
+    {
+        if(verbose)
+        {
+            bnw::cout << "Using " << getStrategyName(cost.strategy) << " for " << filePath.filename()
+                      << ", estimated " << std::lround(cost.seconds * 1000) << "ms" << std::endl;
+        }
+        const auto startTime = std::chrono::steady_clock::now();
+        bool done = true;
+        try
+        {
+            switch(cost.strategy)
+            {
+                case UpdateStrategy::LocalCopy: done = copyUpdatedFile(itCopy->second, filePath, verbose); break;
+                case UpdateStrategy::ChunkRepair:
+                    done = repairChunks(channel.httpBase, installation.workPath, file.path,
+                                        channel.chunkLists.at(file.path), file.corruptChunks);
+                    if(done)
+                    {
+                        // Only the repaired chunks were checked
+                        const std::string digest = hashFile(filePath.string(), getHashAlgorithm(file.hash));
+                        done = digest == file.hash;
+                        if(done)
+                            installation.hashCache.update(filePath.string(), statFile(filePath.string()), digest);
+                        else
+                            bnw::cout << "Repaired " << filePath.filename() << " is still outdated" << std::endl;
+                    }
+                    break;
+                case UpdateStrategy::Delta:
+                    done =
+                      applyPatch(channel.httpBase, installation.workPath, file.path, file.hash,
+                                 channel.deltas.at(std::make_pair(file.digest, file.hash)), &installation.hashCache);
+                    break;
+                case UpdateStrategy::Pack:
+                    done = packStore.extract(*pack, file.hash, filePath);
+                    if(done)
+                        bnw::cout << "Extracted " << filePath.filename() << " from pack" << std::endl;
+                    break;
+                case UpdateStrategy::Seekable:
+                case UpdateStrategy::Full:
+                {
+                    // Throws if the file could not be updated
+                    const bool trySeekable = cost.strategy == UpdateStrategy::Seekable;
+                    if(objectCache)
+                        updateFileCached(*objectCache, installation, file, trySeekable, verbose);
+                    else
+                    {
+                        updateFile(channel.httpBase, installation.workPath, file.path, file.hash, verbose,
+                                   &installation.journal, &installation.hashCache, trySeekable);
+                    }
+                    break;
+                }
+            }
+        } catch(const std::exception& e)
+        {
+            // The failure of the last strategy is the one reported
+            if(&cost == &plan.back())
+                throw;
+            bnw::cout << "Updating " << filePath.filename() << " by " << getStrategyName(cost.strategy)
+                      << " failed: " << e.what() << std::endl;
+            done = false;
+        }
+        if(!done)
+            continue;
+        if(cost.strategy == UpdateStrategy::LocalCopy || cost.strategy == UpdateStrategy::ChunkRepair
+           || cost.strategy == UpdateStrategy::Delta || cost.strategy == UpdateStrategy::Pack)
+            installation.journal.record(file.path, JournalStep::Committed);
+        const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+        planner.addResult(cost.strategy, cost.seconds, duration.count());
+        updated = true;
+        break;
+    }
+    if(!updated)
+        throw std::runtime_error("Failed to update " + filePath.string());
+    updatedFiles.emplace(file.hash, filePath);
+}
+
+/// Use the packs which are kept from an earlier run or cheaper to download than the outdated files in them.
+/// Before the verification only missing files and files of a different size are known to be outdated
+void selectPacks(const std::vector<std::unique_ptr<Installation>>& installations, PackStore& packStore,
+                 const bool verbose)
+{
+    for(const auto& installation : installations)
+    {
+        const Channel& channel = *installation->channel;
+        if(channel.packs.empty())
+            continue;
+        // Pack index and size of the entries by their hash, so each file is looked up once
+        std::unordered_multimap<std::string_view, std::pair<size_t, uint64_t>> packEntries;
+        for(size_t i = 0; i < channel.packs.size(); i++)
+        {
+            for(const auto& entry : channel.packs[i].entries)
+                packEntries.emplace(entry.first, std::make_pair(i, entry.second.size));
+        }
+        std::vector<size_t> numFiles(channel.packs.size());
+        std::vector<uint64_t> filesSize(channel.packs.size());
+        for(size_t i = 0; i < channel.files.size(); i++)
+        {
+            const FileMetadata& metadata = installation->metadata[i];
+            const auto entries = packEntries.equal_range(channel.files[i].first);
+            for(auto it = entries.first; it != entries.second; ++it)
+            {
+                const size_t packIdx = it->second.first;
+                if(!metadata.exists || metadata.size != it->second.second)
+                {
+                    numFiles[packIdx]++;
+                    filesSize[packIdx] += it->second.second;
+                }
+            }
+        }
+        // Packs are downloaded from the channel listing them
+        const auto downloadPack = [&channel, verbose](const SmallFilePack& pack, const bfs::path& dirPath) {
+            const bfs::path packPath = getLocalPath(dirPath, pack.name);
+            bfs::create_directories(packPath.parent_path());
+            updateFile(channel.httpBase, dirPath, pack.name, pack.digest, verbose);
+            return packPath;
+        };
+        for(size_t i = 0; i < channel.packs.size(); i++)
+        {
+            const SmallFilePack& pack = channel.packs[i];
+            if(packStore.isCached(pack) || getStrategyPlanner().isPackCheaper(pack.size, numFiles[i], filesSize[i]))
+            {
+                packStore.add(pack, downloadPack);
+                if(verbose)
+                    bnw::cout << "Using pack " << pack.name << " for " << numFiles[i] << " outdated files" << std::endl;
+            }
+        }
+    }
+}
+
+/// Delay before files whose update failed in watch mode are tried again
+constexpr std::chrono::seconds watchRetryDelay{30};
+
+/// Watch the files of the installation for modifications and repair modified ones until interrupted.
+/// Modified files are updated by the same strategies as outdated files of a regular run. Files whose update failed,
+/// e.g. because the server was not reachable, are retried with the next batch
+void watchFiles(Installation& installation, const ObjectCache* objectCache, PackStore& packStore, const bool verbose)
+{
+    const auto& files = installation.channel->files;
+    std::vector<std::string> filePaths;
+    filePaths.reserve(files.size());
+    std::transform(files.begin(), files.end(), std::back_inserter(filePaths), [&installation](const auto& file) {
+        return getLocalPath(installation.workPath, file.second).string();
+    });
+
+    ChangeWatcher watcher(filePaths);
+    bnw::cout << "Watching " << files.size() << " files for changes. Press Ctrl+C to stop." << std::endl;
+    std::set<size_t> failedFiles;
+    while(true)
+    {
+        const auto maxWait =
+          failedFiles.empty() ? std::chrono::milliseconds(-1) : std::chrono::milliseconds(watchRetryDelay);
+        std::vector<size_t> changedFiles = watcher.waitForChanges(std::chrono::seconds(2), maxWait);
+        if(ChangeWatcher::isInterrupted())
+            break;
+        changedFiles.insert(changedFiles.end(), failedFiles.begin(), failedFiles.end());
+        std::sort(changedFiles.begin(), changedFiles.end());
+        changedFiles.erase(std::unique(changedFiles.begin(), changedFiles.end()), changedFiles.end());
+        failedFiles.clear();
+
+        std::vector<std::pair<size_t, std::unique_ptr<OutdatedFile>>> outdatedFiles;
+        std::vector<std::string_view> missingDirFiles;
+        for(const size_t idx : changedFiles)
+        {
+            installation.hashCache.invalidate(filePaths[idx]);
+            installation.metadata[idx] = statFile(filePaths[idx]);
+            try
+            {
+                auto file = verifyFile(installation, idx, false);
+                if(!file)
+                    continue;
+                if(verbose)
+                    bnw::cout << "File " << filePaths[idx] << " was modified" << std::endl;
+                if(!file->metadata.parentExists)
+                    missingDirFiles.push_back(file->path);
+                outdatedFiles.emplace_back(idx, std::move(file));
+            } catch(const std::exception& e)
+            {
+                bnw::cerr << "Failed to check " << filePaths[idx] << ": " << e.what() << std::endl;
+                failedFiles.insert(idx);
+            }
+        }
+
+        try
+        {
+            createDirectories(installation.workPath, missingDirFiles);
+        } catch(const std::exception& e)
+        {
+            // The files in them fail and are retried
+            bnw::cerr << e.what();
+        }
+        std::unordered_map<std::string, bfs::path> updatedFiles;
+        for(const auto& file : outdatedFiles)
+        {
+            try
+            {
+                updateOutdatedFile(installation, *file.second, updatedFiles, objectCache, packStore, verbose);
+            } catch(const std::exception& e)
+            {
+                bnw::cerr << "Failed to update " << filePaths[file.first] << ": " << e.what() << std::endl;
+                failedFiles.insert(file.first);
+            }
+        }
+        if(!failedFiles.empty())
+        {
+            bnw::cerr << "Retrying " << failedFiles.size() << " files in " << watchRetryDelay.count() << "s"
+                      << std::endl;
+        }
+
+        if(!installation.hashCache.save())
+            bnw::cerr << "Warning: Failed to save hash cache" << std::endl;
+        // Failed files are checked again, so only the payloads of an interrupted download are lost
+        installation.journal.finish();
+        if(!getStrategyPlanner().save())
+            bnw::cerr << "Warning: Failed to save measured throughputs" << std::endl;
+        // Removed directories might have been recreated
+        watcher.refresh();
+    }
+}
+
+/// Parse a size in bytes with an optional suffix K, M or G
+uint64_t parseSize(const std::string& value)
+{
+    size_t suffixPos = 0;
+    uint64_t result = 0;
+    try
+    {
+        result = std::stoull(value, &suffixPos);
+    } catch(const std::logic_error&)
+    {
+        throw std::runtime_error("Invalid size: " + value);
+    }
+    const std::string suffix = value.substr(suffixPos);
+    if(suffix == "K" || suffix == "k")
+        return result << 10;
+    if(suffix == "M" || suffix == "m")
+        return result << 20;
+    if(suffix == "G" || suffix == "g")
+        return result << 30;
+    if(!suffix.empty())
+        throw std::runtime_error("Invalid size: " + value);
+    return result;
+}
+
+/// Split a comma separated list
+std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> result;
+    std::stringstream stream(list);
+    std::string item;
+    while(getline(stream, item, ','))
+    {
+        if(!item.empty())
+            result.push_back(item);
+    }
+    return result;
+}
+
+/// Check all files of the installation, e.g. before its slot is activated.
+/// Only files whose digest was not recorded in the hash cache are hashed again
+bool verifyAllFiles(Installation& installation)
+{
+    std::atomic<bool> allUpToDate(true);
+    Executor::TaskGroup group(getExecutor());
+    for(const auto& file : installation.channel->files)
+    {
+        group.run([&]() {
+            const std::string filePath = getLocalPath(installation.workPath, file.second).string();
+            if(!isUpToDate(file.first, filePath, statFile(filePath), installation.hashCache, true))
+            {
+                bnw::cerr << "File " << filePath << " is not up to date" << std::endl;
+                allUpToDate = false;
+            }
+        });
+    }
+    group.wait();
+    return allUpToDate;
+}
+
 void executeUpdate(int argc, char* argv[])
 {
     bool updated = false;
     bool verbose = false;
     bool nightly = true;
+    bool useHashCache = true;
+    bool watch = false;
+    bool showStats = false;
+    bool useSlots = false;
+    bool rollback = false;
+    unsigned startJitter = 0;
+    std::unique_ptr<ObjectCache> objectCache;
     bfs::path workPath = bfs::path(argv[0]).parent_path().lexically_normal();
 
     // If the installation is the default one, update current installation
@@ -596,106 +1868,363 @@ void executeUpdate(int argc, char* argv[])
         workPath = tmpPath;
 #endif
 
+    // Installations given by --dir <path>[@stable|@nightly], without channel the global one is used
+    std::vector<std::pair<bfs::path, boost::optional<bool>>> targets;
+    // Platforms to update, each given by a comma separated list
+    std::vector<std::string> platformTargets = {TARGET}, platformArchs = {ARCH};
     if(argc > 1)
     {
         for(int i = 1; i < argc; ++i)
         {
             if(strcmp(argv[i], "--verbose") == 0 || strcmp(argv[i], "-v") == 0)
                 verbose = true;
-            if(strcmp(argv[i], "--dir") == 0 || strcmp(argv[i], "-d") == 0)
-                workPath = argv[++i];
+            if((strcmp(argv[i], "--dir") == 0 || strcmp(argv[i], "-d") == 0) && i + 1 < argc)
+            {
+                std::string target = argv[++i];
+                boost::optional<bool> targetNightly;
+                for(const bool channelNightly : {false, true})
+                {
+                    const std::string suffix = channelNightly ? "@nightly" : "@stable";
+                    if(target.size() > suffix.size()
+                       && target.compare(target.size() - suffix.size(), suffix.size(), suffix) == 0)
+                    {
+                        target.resize(target.size() - suffix.size());
+                        targetNightly = channelNightly;
+                    }
+                }
+                targets.emplace_back(target, targetNightly);
+            }
+            if(strcmp(argv[i], "--target") == 0 && i + 1 < argc)
+                platformTargets = splitList(argv[++i]);
+            if(strcmp(argv[i], "--arch") == 0 && i + 1 < argc)
+                platformArchs = splitList(argv[++i]);
             if(strcmp(argv[i], "--stable") == 0 || strcmp(argv[i], "-s") == 0)
                 nightly = false;
+            if(strcmp(argv[i], "--no-cache") == 0)
+                useHashCache = false;
+            if(strcmp(argv[i], "--watch") == 0)
+                watch = true;
+            if(strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc)
+                getMemoryBudget().setLimit(parseSize(argv[++i]));
+            if(strcmp(argv[i], "--stats") == 0)
+                showStats = true;
+            // Workers + 1 for the main thread, which only helps with the work of files in progress
+            if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                setExecutorThreads(static_cast<unsigned>(std::max(1, atoi(argv[++i]))));
+            if(strcmp(argv[i], "--slots") == 0)
+                useSlots = true;
+            if(strcmp(argv[i], "--rollback") == 0)
+                rollback = true;
+            if(strcmp(argv[i], "--jitter") == 0 && i + 1 < argc)
+                startJitter = static_cast<unsigned>(std::max(0, atoi(argv[++i])));
+            if(strcmp(argv[i], "--object-cache") == 0 && i + 1 < argc)
+                objectCache = std::make_unique<ObjectCache>(bfs::absolute(argv[++i]));
+            if(strcmp(argv[i], "--max-write-rate") == 0 && i + 1 < argc)
+                getWriteThrottle().setRate(parseSize(argv[++i]));
+            if(strcmp(argv[i], "--write-sync") == 0 && i + 1 < argc)
+                getWriteThrottle().setSyncInterval(parseSize(argv[++i]));
+            if(strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+            {
+                std::string& server = getTransferSettings().server;
+                server = argv[++i];
+                if(server.empty() || server.back() != '/')
+                    server += '/';
+            }
+            if(strcmp(argv[i], "--timeout") == 0 && i + 1 < argc)
+                getTransferSettings().stallTimeout = std::chrono::seconds(std::max(1, atoi(argv[++i])));
+            if(strcmp(argv[i], "--retries") == 0 && i + 1 < argc)
+                getTransferSettings().maxAttempts = static_cast<unsigned>(std::max(0, atoi(argv[++i]))) + 1;
         }
     }
+    if(targets.empty())
+        targets.emplace_back(workPath, boost::none);
 
-    if(verbose)
-        bnw::cout << "Using directory " << workPath << std::endl;
-    boost::system::error_code error;
-    bfs::current_path(workPath, error);
-    if(error)
-        bnw::cerr << "Warning: Failed to set working directory: " << error << std::endl;
+    std::vector<std::string> platforms;
+    for(const std::string& platformTarget : platformTargets)
+    {
+        for(const std::string& platformArch : platformArchs)
+            platforms.push_back(platformTarget + "." + platformArch);
+    }
+    if(platforms.empty())
+        throw std::runtime_error("No target or architecture given");
 
-    if(!isCurrentDirWritable())
+    // With multiple platforms each one is put into a subdirectory <target>.<arch> of the given directories
+    struct InstallTarget
+    {
+        bfs::path workPath;
+        bool nightly;
+        std::string platform;
+    };
+    std::vector<InstallTarget> installTargets;
+    for(const auto& target : targets)
     {
-        if(runAsAdmin(argc, argv))
+        for(const std::string& platform : platforms)
         {
-            bnw::cout << "Update should have been run successfully" << std::endl;
-            return;
-        } else
-            throw std::runtime_error("Update failed. Current dir is not writeable");
+            bfs::path targetPath = bfs::absolute(target.first).lexically_normal();
+            if(platforms.size() > 1)
+            {
+                targetPath /= platform;
+                boost::system::error_code ec;
+                bfs::create_directories(targetPath, ec);
+            }
+            installTargets.push_back({targetPath, target.second.value_or(nightly), platform});
+        }
     }
 
-    // initialize curl
-    curl_global_init(CURL_GLOBAL_ALL);
-    atexit(curl_global_cleanup);
+    if(watch && !ChangeWatcher::isSupported())
+        throw std::runtime_error("--watch is not supported on this platform");
+    if(watch && installTargets.size() > 1)
+        throw std::runtime_error("--watch can only be used with a single installation");
+    if((useSlots || rollback) && !SlotLayout::isSupported())
+        throw std::runtime_error("Slots are not supported on this platform");
 
-    // download filelist
-    if(verbose)
-        bnw::cout << "Requesting current version information from server..." << std::endl;
-    std::string httpbase, filelist;
-    const auto possibleBases = getPossibleHttpBases(nightly);
-    for(size_t i = 0; i < possibleBases.size(); i++)
+    if(rollback)
     {
-        auto filelistOpt = DownloadFile(possibleBases[i] + FILELIST);
-        if(!filelistOpt)
-            bnw::cout << "Warning: Was not able to get masterfile " << i << ", trying older one" << std::endl;
-        else
+        for(const auto& target : installTargets)
         {
-            filelist = *filelistOpt;
-            httpbase = possibleBases[i];
-            break;
+            SlotLayout slotLayout(target.workPath);
+            if(!slotLayout.rollback())
+                throw std::runtime_error("No previous slot to switch back to in " + target.workPath.string());
+            bnw::cout << "Switched " << target.workPath << " back to " << slotLayout.getCurrentSlot() << std::endl;
         }
+        return;
     }
-    if(filelist.empty())
-        throw std::runtime_error("Could not get any master file");
 
-    // httpbase now includes targetpath and filepath
+    for(const auto& target : installTargets)
+    {
+        if(verbose)
+            bnw::cout << "Using directory " << target.workPath << std::endl;
+        if(!isDirWritable(target.workPath))
+        {
+            if(runAsAdmin(argc, argv))
+            {
+                bnw::cout << "Update should have been run successfully" << std::endl;
+                return;
+            } else
+                throw std::runtime_error("Update failed. Directory " + target.workPath.string() + " is not writeable");
+        }
+    }
 
-    // download linklist
-    const auto linklist = DownloadFile(httpbase + LINKLIST);
-    if(!linklist)
-        bnw::cout << "Warning: Was not able to get linkfile, ignoring" << std::endl;
+    // Spread the requests of many hosts started at the same time
+    if(startJitter > 0)
+    {
+        std::mt19937 rng(std::random_device{}());
+        const std::chrono::milliseconds delay(
+          std::uniform_int_distribution<unsigned>(0, startJitter * 1000 - 1)(rng));
+        if(verbose)
+            bnw::cout << "Waiting " << delay.count() / 1000.0 << "s before starting" << std::endl;
+        std::this_thread::sleep_for(delay);
+    }
 
-    if(verbose)
-        bnw::cout << "Parsing update list..." << std::endl;
+    // Throughputs measured by earlier runs, shared by all installations
+    getStrategyPlanner().load(installTargets.front().workPath / PLANNER);
 
-    const auto files = parseFileList(filelist);
-    const auto itSavegameversion = std::find_if(
-      files.begin(), files.end(), [](const auto& it) { return it.second.find(SAVEGAMEVERSION) != std::string::npos; });
+    // initialize curl
+    curl_global_init(CURL_GLOBAL_ALL);
+    atexit(curl_global_cleanup);
 
-    if(itSavegameversion != files.end() && bfs::exists(itSavegameversion->second))
+    // Each channel is only fetched once per platform, even if used by multiple installations
+    std::map<std::pair<bool, std::string>, Channel> channels;
+    std::vector<std::unique_ptr<Installation>> installations;
+    for(const auto& target : installTargets)
     {
-        if(!ValidateSavegameVersion(httpbase, itSavegameversion->second))
-            return;
+        const auto channelKey = std::make_pair(target.nightly, target.platform);
+        auto itChannel = channels.find(channelKey);
+        if(itChannel == channels.end())
+            itChannel = channels.emplace(channelKey, fetchChannel(target.nightly, target.platform, verbose)).first;
+        const Channel& channel = itChannel->second;
+
+        // Path of the installation used so far, which differs from the one updated when using slots
+        bfs::path activePath = target.workPath;
+        std::unique_ptr<Installation> installation;
+        std::set<std::string> linkedFiles;
+        if(useSlots)
+        {
+            auto slotLayout = std::make_unique<SlotLayout>(target.workPath);
+            const std::string slotId = md5string(channel.fileList).substr(0, 16);
+            const auto linked = slotLayout->prepareSlot(slotId, channel.files);
+            linkedFiles.insert(linked.begin(), linked.end());
+            activePath = slotLayout->getCurrentSlot();
+            installation = std::make_unique<Installation>(slotLayout->getSlotPath(slotId), channel);
+            installation->slotLayout = std::move(slotLayout);
+            installation->slotId = slotId;
+            if(verbose)
+                bnw::cout << "Using slot " << installation->workPath << std::endl;
+        } else
+            installation = std::make_unique<Installation>(target.workPath, channel);
+        const bfs::path& installPath = installation->workPath;
+        std::vector<std::string> filePaths;
+        filePaths.reserve(channel.files.size());
+        std::transform(channel.files.begin(), channel.files.end(), std::back_inserter(filePaths),
+                       [&installPath](const auto& file) { return getLocalPath(installPath, file.second).string(); });
+        const auto scanStartTime = PhaseTimes::Clock::now();
+        installation->metadata = scanMetadata(filePaths);
+        getPhaseTimes().add("metadata scan", PhaseTimes::Clock::now() - scanStartTime);
+
+        if(!linkedFiles.empty())
+        {
+            // Linked files are the same as in the active slot, so are their cached digests
+            const HashCache activeHashCache(activePath / HASHCACHE);
+            for(size_t i = 0; i < channel.files.size(); i++)
+            {
+                if(!linkedFiles.count(channel.files[i].second))
+                    continue;
+                const std::string activeFilePath = getLocalPath(activePath, channel.files[i].second).string();
+                if(const auto digest = activeHashCache.lookup(activeFilePath, installation->metadata[i]))
+                    installation->hashCache.update(filePaths[i], installation->metadata[i], *digest);
+            }
+        }
+
+        const auto itSavegameversion =
+          std::find_if(channel.files.begin(), channel.files.end(),
+                       [](const auto& it) { return it.second.find(SAVEGAMEVERSION) != std::string::npos; });
+        if(itSavegameversion != channel.files.end() && !activePath.empty())
+        {
+            const std::string savegameversionPath = getLocalPath(activePath, itSavegameversion->second).string();
+            if(bfs::exists(savegameversionPath) && !ValidateSavegameVersion(channel.httpBase, savegameversionPath))
+                continue;
+        }
+        if(installation->journal.isResumed())
+            bnw::cout << "Resuming interrupted update of " << target.workPath << std::endl;
+        // Missing directories are known from the scan, so they are created at once before any file is updated
+        std::vector<std::string_view> missingDirFiles;
+        for(size_t i = 0; i < channel.files.size(); i++)
+        {
+            if(!installation->metadata[i].parentExists)
+                missingDirFiles.push_back(channel.files[i].second);
+        }
+        createDirectories(installPath, missingDirFiles);
+        installations.push_back(std::move(installation));
     }
 
-    const auto links = parseLinkList(*linklist);
+    PackStore packStore(installTargets.front().workPath / PACKCACHE);
+    const auto packStartTime = PhaseTimes::Clock::now();
+    selectPacks(installations, packStore, verbose);
+    getPhaseTimes().add("planning", PhaseTimes::Clock::now() - packStartTime);
+
+    // check hashes of files, using the cached value for files which did not change since the last run.
+    // Outdated files are updated by this thread as soon as they are found while the verification continues
+    size_t numFiles = 0;
+    // Number of not yet verified files per hash over all installations. Only hashes of multiple files are kept,
+    // as a file with a unique hash can't be copied from another one. The keys refer to the channels
+    std::unordered_map<std::string_view, size_t> numUnverified;
+    for(const auto& installation : installations)
+    {
+        numFiles += installation->channel->files.size();
+        for(const auto& file : installation->channel->files)
+            numUnverified[file.first]++;
+    }
+    for(auto it = numUnverified.begin(); it != numUnverified.end();)
+        it = it->second > 1 ? std::next(it) : numUnverified.erase(it);
+    VerifiedFileHandoff verifiedFiles;
+    Executor::TaskGroup verification(getExecutor());
+    const auto verificationStartTime = PhaseTimes::Clock::now();
+    auto verificationFinishTime = verificationStartTime;
+    startVerification(installations, useHashCache, verification, verifiedFiles);
+
+    // Local copies of files by their hash, which are up to date in one of the installations
+    std::unordered_map<std::string, bfs::path> updatedFiles;
+    // Outdated files which may be copied from another installation once verified there
+    std::vector<std::pair<Installation*, OutdatedFile>> deferredFiles;
+    const Installation* lastUpdated = nullptr;
+    const auto updateVerifiedFile = [&](Installation& installation, const OutdatedFile& file) {
+        if(installations.size() > 1 && lastUpdated != &installation)
+            bnw::cout << "Updating installation in " << installation.workPath << std::endl;
+        lastUpdated = &installation;
+        const auto updateStartTime = PhaseTimes::Clock::now();
+        updateOutdatedFile(installation, file, updatedFiles, objectCache.get(), packStore, verbose);
+        getPhaseTimes().add("updating", PhaseTimes::Clock::now() - updateStartTime);
+        updated = true;
+    };
 
-    // check md5 of files and download them
-    for(const auto& file : files)
+    std::array<VerifiedFile, 32> batch;
+    for(size_t numVerified = 0; numVerified < numFiles;)
     {
-        const std::string hash = file.first;
-        const std::string filePath = file.second;
+        const size_t count = verifiedFiles.pop(batch.data(), batch.size());
+        numVerified += count;
+        for(size_t i = 0; i < count; i++)
+        {
+            VerifiedFile& result = batch[i];
+            if(result.error)
+                std::rethrow_exception(result.error);
+            verificationFinishTime = std::max(verificationFinishTime, result.finishTime);
+            Installation& installation = *installations[result.installationIdx];
+            const auto& file = installation.channel->files[result.fileIdx];
+            const auto itUnverified = numUnverified.find(file.first);
+            if(itUnverified == numUnverified.end())
+            {
+                if(result.outdatedFile)
+                    updateVerifiedFile(installation, *result.outdatedFile);
+                continue;
+            }
+            itUnverified->second--;
+            if(!result.outdatedFile)
+                updatedFiles.emplace(file.first, getLocalPath(installation.workPath, file.second));
+            else if(!updatedFiles.count(file.first) && itUnverified->second > 0)
+                deferredFiles.emplace_back(&installation, std::move(*result.outdatedFile));
+            else
+                updateVerifiedFile(installation, *result.outdatedFile);
+        }
+    }
+    verification.wait();
+    getPhaseTimes().add("verification", verificationFinishTime - verificationStartTime);
+    for(const auto& deferredFile : deferredFiles)
+        updateVerifiedFile(*deferredFile.first, deferredFile.second);
+    packStore.removeUnused();
 
-        if(hash == md5sum(filePath))
-            continue;
+    for(const auto& installation : installations)
+    {
+        const Channel& channel = *installation->channel;
+        if(verbose)
+            bnw::cout << "Updating folder structure..." << std::endl;
 
-        updateFile(httpbase, filePath, verbose);
-        updated = true;
-    }
+        for(const auto& link : channel.links)
+        {
+            // Note: Symlink = first pointing to second (second exists)
+            copyOrSymlink(link.second, getLocalPath(installation->workPath, link.first));
+        }
 
-    if(verbose)
-        bnw::cout << "Updating folder structure..." << std::endl;
+        if(installation->slotLayout && !verifyAllFiles(*installation))
+        {
+            throw std::runtime_error("Verification of slot " + installation->workPath.string()
+                                     + " failed, the active installation was not changed");
+        }
 
-    for(const auto& link : links)
-    {
-        // Note: Symlink = first pointing to second (second exists)
-        copyOrSymlink(link.second, link.first);
+        // Copied and repaired files are hashed again on the next run
+        if(!installation->hashCache.save())
+            bnw::cerr << "Warning: Failed to save hash cache" << std::endl;
+        installation->journal.finish();
+
+        if(installation->slotLayout)
+        {
+            installation->slotLayout->activate(installation->slotId, channel.files);
+            if(verbose)
+                bnw::cout << "Activated slot " << installation->workPath << std::endl;
+        }
     }
 
     if(updated)
         bnw::cout << "Update finished!" << std::endl;
+    if(!getStrategyPlanner().save())
+        bnw::cerr << "Warning: Failed to save measured throughputs" << std::endl;
+
+    if(showStats)
+    {
+        getPhaseTimes().print(bnw::cout);
+        if(const uint64_t peakMemory = getPeakMemoryUsage())
+            bnw::cout << "Peak process memory: " << peakMemory / 1024 << " KiB" << std::endl;
+        const MemoryBudget& budget = getMemoryBudget();
+        bnw::cout << "Peak buffer memory: " << budget.getPeak() / 1024 << " KiB";
+        if(budget.getLimit() != 0)
+            bnw::cout << " of " << budget.getLimit() / 1024 << " KiB";
+        bnw::cout << std::endl;
+        getStrategyPlanner().printStats(bnw::cout);
+    }
+
+    if(watch && !installations.empty())
+    {
+        watchFiles(*installations.front(), objectCache.get(), packStore, verbose);
+    }
 }
 } // namespace
 
@@ -0,0 +1,143 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "seekablePayload.h"
+#include "bz2Decompressor.h"
+#include "executor.h"
+#include "memoryBudget.h"
+#include "writeThrottle.h"
+#include <boost/filesystem.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+namespace bfs = boost::filesystem;
+namespace bnw = boost::nowide;
+
+namespace seekable {
+
+namespace {
+    constexpr uint32_t seekableMagic = 0x53325A53; // "SZ2S"
+    constexpr uint32_t frameEntrySize = 8;
+
+    uint32_t readUInt32LE(const char* data)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+        return static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8
+               | static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+    }
+} // namespace
+
+uint64_t getSeekTableSize(const std::string& footer)
+{
+    if(footer.size() != footerSize || readUInt32LE(&footer[4]) != seekableMagic)
+        return 0;
+    return static_cast<uint64_t>(readUInt32LE(&footer[0])) * frameEntrySize + footerSize;
+}
+
+std::vector<Frame> parseSeekTable(const std::string& seekTable)
+{
+    if(seekTable.size() < footerSize
+       || getSeekTableSize(seekTable.substr(seekTable.size() - footerSize)) != seekTable.size())
+        throw std::runtime_error("Invalid seek table");
+    const uint32_t numFrames = readUInt32LE(&seekTable[seekTable.size() - footerSize]);
+    std::vector<Frame> frames;
+    frames.reserve(numFrames);
+    uint64_t compressedOffset = 0, decompressedOffset = 0;
+    for(uint32_t i = 0; i < numFrames; i++)
+    {
+        const char* entry = &seekTable[i * frameEntrySize];
+        Frame frame{compressedOffset, readUInt32LE(entry), decompressedOffset, readUInt32LE(entry + 4)};
+        compressedOffset += frame.compressedSize;
+        decompressedOffset += frame.decompressedSize;
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+std::vector<Frame> readSeekTable(const bfs::path& payloadPath)
+{
+    bnw::ifstream file(payloadPath, std::ios::binary | std::ios::ate);
+    const auto fileSize = static_cast<uint64_t>(file.tellg());
+    std::string footer(footerSize, '\0');
+    if(!file || fileSize < footerSize || !file.seekg(fileSize - footerSize) || !file.read(&footer[0], footerSize))
+        throw std::runtime_error("Failed to read " + payloadPath.string());
+    const uint64_t seekTableSize = getSeekTableSize(footer);
+    if(seekTableSize == 0 || seekTableSize > fileSize)
+        throw std::runtime_error("Invalid seek table in " + payloadPath.string());
+    std::string seekTable(static_cast<size_t>(seekTableSize), '\0');
+    if(!file.seekg(fileSize - seekTableSize) || !file.read(&seekTable[0], seekTable.size()))
+        throw std::runtime_error("Failed to read " + payloadPath.string());
+    auto frames = parseSeekTable(seekTable);
+    if(!frames.empty() && frames.back().compressedOffset + frames.back().compressedSize != fileSize - seekTableSize)
+        throw std::runtime_error("Seek table does not match size of " + payloadPath.string());
+    return frames;
+}
+
+std::pair<size_t, size_t> findFrames(const std::vector<Frame>& frames, uint64_t offset, uint64_t length)
+{
+    const auto frameEndsBefore = [](const Frame& frame, uint64_t value) {
+        return frame.decompressedOffset + frame.decompressedSize <= value;
+    };
+    const auto itFirst = std::lower_bound(frames.begin(), frames.end(), offset, frameEndsBefore);
+    const uint64_t lastByte = offset + std::max<uint64_t>(length, 1) - 1;
+    const auto itLast = std::lower_bound(itFirst, frames.end(), lastByte, frameEndsBefore);
+    if(itLast == frames.end())
+        throw std::runtime_error("Byte range exceeds payload");
+    return {static_cast<size_t>(itFirst - frames.begin()), static_cast<size_t>(itLast - frames.begin())};
+}
+
+bool decompressFrame(const char* data, const Frame& frame, std::string& out)
+{
+    out.resize(frame.decompressedSize);
+    const auto decompressor = getBz2DecompressorPool().acquire();
+    return decompressor->decompressBuffer(data, frame.compressedSize, out.empty() ? nullptr : &out[0], out.size());
+}
+
+bool decompressFile(const bfs::path& payloadPath, const std::vector<Frame>& frames, const bfs::path& outputPath,
+                    Executor& executor)
+{
+    std::atomic<size_t> nextFrame(0);
+    std::atomic<bool> failed(false);
+    WriteThrottle::File throttledFile(getWriteThrottle(), outputPath);
+
+    // Each task uses its own file handles and buffers and takes the next unprocessed frame
+    const auto decompressFrames = [&]() {
+        bnw::ifstream input(payloadPath, std::ios::binary);
+        bnw::fstream output(outputPath, std::ios::in | std::ios::out | std::ios::binary);
+        std::string compressed, decompressed;
+        size_t idx;
+        while(!failed && (idx = nextFrame++) < frames.size())
+        {
+            const Frame& frame = frames[idx];
+            // Memory is only reserved while processing a frame, so waiting tasks can't block each other
+            MemoryBudget::Lease lease(getMemoryBudget(),
+                                      static_cast<uint64_t>(frame.compressedSize) + frame.decompressedSize);
+            compressed.resize(frame.compressedSize);
+            if(!input.seekg(static_cast<std::streamoff>(frame.compressedOffset))
+               || !input.read(&compressed[0], compressed.size())
+               || !decompressFrame(compressed.data(), frame, decompressed))
+            {
+                failed = true;
+                break;
+            }
+            throttledFile.reserve(decompressed.size());
+            if(!output.seekp(static_cast<std::streamoff>(frame.decompressedOffset))
+               || !output.write(decompressed.data(), decompressed.size()))
+                failed = true;
+        }
+        if(!output.flush())
+            failed = true;
+    };
+
+    const size_t numTasks = std::min<size_t>(executor.getNumThreads(), frames.size());
+    Executor::TaskGroup group(executor);
+    for(size_t i = 0; i < numTasks; i++)
+        group.run(decompressFrames, Executor::Priority::High);
+    group.wait();
+    return !failed;
+}
+
+} // namespace seekable
@@ -0,0 +1,46 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Executor;
+
+/// Seekable payload format (.bzs):
+/// The file is split into frames which are compressed as independent bzip2 streams and concatenated.
+/// They are followed by a seek table with the compressed and decompressed size of each frame (2x uint32 LE)
+/// and a footer consisting of the number of frames (uint32 LE) and a magic value (uint32 LE).
+/// This allows fetching and decompressing any byte range of the file and decompressing frames in parallel.
+namespace seekable {
+
+constexpr uint32_t footerSize = 8;
+
+struct Frame
+{
+    uint64_t compressedOffset;
+    uint32_t compressedSize;
+    uint64_t decompressedOffset;
+    uint32_t decompressedSize;
+};
+
+/// Get the size of the seek table including the footer. Return 0 if the footer is invalid
+uint64_t getSeekTableSize(const std::string& footer);
+/// Parse the seek table (including the footer) of a payload. Throws on error
+std::vector<Frame> parseSeekTable(const std::string& seekTable);
+/// Read the seek table from the end of a payload file. Throws on error
+std::vector<Frame> readSeekTable(const boost::filesystem::path& payloadPath);
+/// Get the range [first, last] of frames containing the given decompressed byte range
+std::pair<size_t, size_t> findFrames(const std::vector<Frame>& frames, uint64_t offset, uint64_t length);
+/// Decompress a single frame. Return false on error
+bool decompressFrame(const char* data, const Frame& frame, std::string& out);
+/// Decompress all frames of the payload file to the already created output file in parallel using the executor
+bool decompressFile(const boost::filesystem::path& payloadPath, const std::vector<Frame>& frames,
+                    const boost::filesystem::path& outputPath, Executor& executor);
+
+} // namespace seekable
@@ -0,0 +1,156 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "slotLayout.h"
+#include <boost/filesystem.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace bfs = boost::filesystem;
+namespace bnw = boost::nowide;
+
+namespace {
+constexpr auto slotsDir = "slots";
+constexpr auto currentLink = "current";
+constexpr auto previousLink = "previous";
+/// Files of the build in the slot, written when the slot is activated
+constexpr auto manifestFile = ".s25update-slot";
+
+/// Read the manifest of a slot as a map from path to hash. Missing or corrupt manifests result in an empty map
+std::unordered_map<std::string, std::string> readManifest(const bfs::path& slotPath)
+{
+    std::unordered_map<std::string, std::string> files;
+    bnw::ifstream file(slotPath / manifestFile);
+    // Format: <hash> <path>
+    std::string line;
+    while(getline(file, line))
+    {
+        const auto pos = line.find(' ');
+        if(pos != std::string::npos)
+            files[line.substr(pos + 1)] = line.substr(0, pos);
+    }
+    return files;
+}
+} // namespace
+
+SlotLayout::SlotLayout(bfs::path rootPath) : rootPath_(std::move(rootPath)) {}
+
+bool SlotLayout::isSupported()
+{
+#ifdef _WIN32
+    // Symlinks require special privileges
+    return false;
+#else
+    return true;
+#endif
+}
+
+bfs::path SlotLayout::getSlotPath(const std::string& slotId) const
+{
+    return rootPath_ / slotsDir / slotId;
+}
+
+bfs::path SlotLayout::getCurrentSlot() const
+{
+    return readLink(currentLink);
+}
+
+bfs::path SlotLayout::getPreviousSlot() const
+{
+    return readLink(previousLink);
+}
+
+std::vector<std::string> SlotLayout::prepareSlot(const std::string& slotId, const FileList& files) const
+{
+    const bfs::path slotPath = getSlotPath(slotId);
+    bfs::create_directories(slotPath);
+    const bfs::path currentSlot = getCurrentSlot();
+    std::vector<std::string> linkedFiles;
+    if(currentSlot.empty() || bfs::equivalent(currentSlot, slotPath))
+        return linkedFiles;
+
+    const auto currentFiles = readManifest(currentSlot);
+    for(const auto& file : files)
+    {
+        const auto itCurrent = currentFiles.find(file.second);
+        if(itCurrent == currentFiles.end() || itCurrent->second != file.first)
+            continue;
+        const bfs::path srcPath = (currentSlot / file.second).lexically_normal();
+        const bfs::path dstPath = (slotPath / file.second).lexically_normal();
+        boost::system::error_code ec;
+        // Files of a resumed preparation are verified by the update
+        if(bfs::exists(dstPath, ec))
+            continue;
+        bfs::create_directories(dstPath.parent_path(), ec);
+        bfs::create_hard_link(srcPath, dstPath, ec);
+        // Files which can't be linked are downloaded or copied by the update
+        if(!ec)
+            linkedFiles.push_back(file.second);
+    }
+    return linkedFiles;
+}
+
+void SlotLayout::activate(const std::string& slotId, const FileList& files)
+{
+    const bfs::path slotPath = getSlotPath(slotId);
+    {
+        bnw::ofstream manifest(slotPath / manifestFile);
+        for(const auto& file : files)
+            manifest << file.first << ' ' << file.second << '\n';
+        if(!manifest.flush())
+            throw std::runtime_error("Failed to write manifest of slot " + slotPath.string());
+    }
+
+    const bfs::path currentSlot = getCurrentSlot();
+    if(!currentSlot.empty() && bfs::equivalent(currentSlot, slotPath))
+        return;
+    if(!currentSlot.empty())
+        replaceLink(previousLink, currentSlot);
+    replaceLink(currentLink, slotPath);
+
+    // Only the active and the previous slot are kept
+    for(const auto& entry : bfs::directory_iterator(rootPath_ / slotsDir))
+    {
+        const bool isKept = bfs::equivalent(entry.path(), slotPath)
+                            || (!currentSlot.empty() && bfs::equivalent(entry.path(), currentSlot));
+        if(isKept)
+            continue;
+        boost::system::error_code ec;
+        bfs::remove_all(entry.path(), ec);
+    }
+}
+
+bool SlotLayout::rollback()
+{
+    const bfs::path currentSlot = getCurrentSlot();
+    const bfs::path previousSlot = getPreviousSlot();
+    if(previousSlot.empty() || !bfs::is_directory(previousSlot))
+        return false;
+    replaceLink(currentLink, previousSlot);
+    if(!currentSlot.empty())
+        replaceLink(previousLink, currentSlot);
+    return true;
+}
+
+bfs::path SlotLayout::readLink(const std::string& name) const
+{
+    boost::system::error_code ec;
+    const bfs::path target = bfs::read_symlink(rootPath_ / name, ec);
+    if(ec || target.empty())
+        return bfs::path();
+    return (rootPath_ / target).lexically_normal();
+}
+
+void SlotLayout::replaceLink(const std::string& name, const bfs::path& slotPath)
+{
+    // Create the new link next to the old one and rename it over the old one, which is atomic
+    const bfs::path linkPath = rootPath_ / name;
+    bfs::path tmpLinkPath = linkPath;
+    tmpLinkPath += ".new";
+    boost::system::error_code ec;
+    bfs::remove(tmpLinkPath, ec);
+    bfs::create_directory_symlink(slotPath.lexically_relative(rootPath_), tmpLinkPath);
+    bfs::rename(tmpLinkPath, linkPath);
+}
@@ -0,0 +1,50 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Installation layout where each build lives in its own slot directory:
+///   <root>/slots/<id>/  files of one build
+///   <root>/current      symlink to the active slot
+///   <root>/previous     symlink to the slot active before the last switch
+/// A new slot shares unchanged files with the active one by hardlinks. It is only activated after it was verified
+/// completely, by atomically replacing the symlink, so users of <root>/current never see a partially updated tree.
+class SlotLayout
+{
+public:
+    /// Files of a build as pairs of hash and path relative to the slot
+    using FileList = std::vector<std::pair<std::string, std::string>>;
+
+    explicit SlotLayout(boost::filesystem::path rootPath);
+
+    /// Check if slots can be used on this platform
+    static bool isSupported();
+
+    /// Path of the slot for a build
+    boost::filesystem::path getSlotPath(const std::string& slotId) const;
+    /// Path of the active slot or an empty path if there is none
+    boost::filesystem::path getCurrentSlot() const;
+    /// Path of the slot which was active before or an empty path if there is none
+    boost::filesystem::path getPreviousSlot() const;
+
+    /// Create the slot for a build, if it does not exist yet. Files with the same path and hash as in the
+    /// active slot are hardlinked into it. Return the paths of the linked files
+    std::vector<std::string> prepareSlot(const std::string& slotId, const FileList& files) const;
+    /// Remember the files of the slot and make it the active one.
+    /// The old active slot becomes the previous one, all other slots are removed
+    void activate(const std::string& slotId, const FileList& files);
+    /// Switch back to the previous slot. Return false if there is none
+    bool rollback();
+
+private:
+    boost::filesystem::path rootPath_;
+
+    boost::filesystem::path readLink(const std::string& name) const;
+    void replaceLink(const std::string& name, const boost::filesystem::path& slotPath);
+};
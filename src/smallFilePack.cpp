@@ -0,0 +1,160 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "smallFilePack.h"
+#include "md5sum.h"
+#include "memoryBudget.h"
+#include "stagedFile.h"
+#include "writeThrottle.h"
+#include <boost/filesystem.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <boost/nowide/iostream.hpp>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace bfs = boost::filesystem;
+namespace bnw = boost::nowide;
+
+std::vector<SmallFilePack> parsePackList(const std::string& packListContents)
+{
+    std::vector<SmallFilePack> result;
+    std::stringstream plstream(packListContents);
+
+    std::string line;
+    while(getline(plstream, line))
+    {
+        if(line.empty())
+            break;
+
+        std::stringstream header(line);
+        SmallFilePack pack;
+        size_t numEntries;
+        if(!(header >> pack.digest >> numEntries) || line.find("  ") == std::string::npos)
+            throw std::runtime_error("Invalid line in pack list: " + line);
+        pack.name = line.substr(line.find("  ") + 2);
+
+        while(pack.entries.size() < numEntries && getline(plstream, line))
+        {
+            std::stringstream entryLine(line);
+            std::string hash;
+            SmallFilePack::Entry entry;
+            if(!(entryLine >> hash >> entry.offset >> entry.size))
+                throw std::runtime_error("Invalid entry in pack " + pack.name + ": " + line);
+            pack.size = std::max(pack.size, entry.offset + entry.size);
+            pack.entries[hash] = entry;
+        }
+        if(pack.entries.size() != numEntries)
+            throw std::runtime_error("Pack list of " + pack.name + " is incomplete");
+
+        result.push_back(std::move(pack));
+    }
+    return result;
+}
+
+PackStore::PackStore(bfs::path dirPath) : dirPath_(std::move(dirPath)) {}
+
+PackStore::~PackStore() = default;
+
+bool PackStore::isCached(const SmallFilePack& pack) const
+{
+    boost::system::error_code ec;
+    return bfs::file_size(dirPath_ / pack.digest, ec) == pack.size && !ec;
+}
+
+void PackStore::add(const SmallFilePack& pack, Download download)
+{
+    const auto samePack = [&pack](const AddedPack& other) { return other.pack->digest == pack.digest; };
+    if(std::none_of(packs_.begin(), packs_.end(), samePack))
+        packs_.push_back(AddedPack{&pack, std::move(download)});
+}
+
+const SmallFilePack* PackStore::find(const std::string& hash) const
+{
+    for(const AddedPack& addedPack : packs_)
+    {
+        if(addedPack.pack->entries.count(hash))
+            return addedPack.pack;
+    }
+    return nullptr;
+}
+
+bool PackStore::extract(const SmallFilePack& pack, const std::string& hash, const bfs::path& filePath)
+{
+    const auto itEntry = pack.entries.find(hash);
+    if(itEntry == pack.entries.end())
+        return false;
+    if(!load(pack))
+        return false;
+    const SmallFilePack::Entry& entry = itEntry->second;
+    // Checked by the digest of the pack, so the file does not need to be hashed again
+    MemoryBudget::Lease lease(getMemoryBudget(), entry.size);
+    std::string data(entry.size, '\0');
+    bnw::ifstream packFile(dirPath_ / pack.digest, std::ios::binary);
+    if(!packFile.seekg(static_cast<std::streamoff>(entry.offset))
+       || !packFile.read(&data[0], static_cast<std::streamsize>(entry.size)))
+        return false;
+    StagedFile stagedFile(filePath);
+    {
+        bnw::ofstream file(stagedFile.getPath(), std::ios::binary);
+        getWriteThrottle().acquire(entry.size);
+        if(!file.write(data.data(), static_cast<std::streamsize>(entry.size)) || !file.flush())
+            return false;
+    }
+    stagedFile.commit();
+    return true;
+}
+
+void PackStore::removeUnused()
+{
+    boost::system::error_code ec;
+    if(!bfs::is_directory(dirPath_, ec))
+        return;
+    std::vector<bfs::path> unusedPaths;
+    for(const auto& entry : bfs::directory_iterator(dirPath_, ec))
+    {
+        const std::string name = entry.path().filename().string();
+        if(std::none_of(packs_.begin(), packs_.end(),
+                        [&name](const AddedPack& addedPack) { return addedPack.pack->digest == name; }))
+            unusedPaths.push_back(entry.path());
+    }
+    for(const bfs::path& path : unusedPaths)
+        bfs::remove_all(path, ec);
+}
+
+bool PackStore::load(const SmallFilePack& pack)
+{
+    auto itLoaded = loadedPacks_.find(pack.digest);
+    if(itLoaded == loadedPacks_.end())
+    {
+        bool isValid = verifyPack(pack);
+        const auto itAdded = std::find_if(packs_.begin(), packs_.end(), [&pack](const AddedPack& addedPack) {
+            return addedPack.pack->digest == pack.digest;
+        });
+        if(!isValid && itAdded != packs_.end())
+        {
+            // Keep only the verified pack under its digest, so a partial download is never used
+            const bfs::path downloadPath = dirPath_ / (pack.digest + ".download");
+            boost::system::error_code ec;
+            try
+            {
+                bfs::create_directories(downloadPath);
+                bfs::rename(itAdded->download(pack, downloadPath), dirPath_ / pack.digest);
+                isValid = verifyPack(pack);
+            } catch(const std::exception& e)
+            {
+                bnw::cerr << "Failed to get pack " << pack.name << ": " << e.what() << std::endl;
+            }
+            bfs::remove_all(downloadPath, ec);
+        }
+        itLoaded = loadedPacks_.emplace(pack.digest, isValid).first;
+    }
+    return itLoaded->second;
+}
+
+bool PackStore::verifyPack(const SmallFilePack& pack) const
+{
+    // The kept pack might have been modified
+    return isCached(pack) && hashFile((dirPath_ / pack.digest).string(), getHashAlgorithm(pack.digest)) == pack.digest;
+}
@@ -0,0 +1,76 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Small files published as one payload. Compressing them together lets the compressor use the similarities
+/// between them (e.g. of translations) and they are fetched with a single request
+struct SmallFilePack
+{
+    struct Entry
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    /// Path of the pack relative to the http base, its payload is <name>.bz2
+    std::string name;
+    /// Digest of the uncompressed pack, using the algorithm of the file list
+    std::string digest;
+    uint64_t size = 0;
+    /// Location of the files in the pack by their hash
+    std::unordered_map<std::string, Entry> entries;
+};
+
+/// Parse the optional pack list of the manifest. A pack is the concatenation of its files.
+/// Format: "<digest> <numEntries>  <name>" followed by one line "<hash> <offset> <size>" per file in the pack
+std::vector<SmallFilePack> parsePackList(const std::string& packListContents);
+
+/// Packs used by this run. Each pack is downloaded at most once, checked on first use and kept in a local directory
+/// by its digest, so later runs don't need to download it again. Files are read from the kept pack when extracted,
+/// so no pack is held in memory
+class PackStore
+{
+public:
+    /// Download the pack into dirPath and return the path of the downloaded file. Throws on failure
+    using Download = std::function<boost::filesystem::path(const SmallFilePack&, const boost::filesystem::path&)>;
+
+    /// Keep the packs in dirPath, which is created if required
+    explicit PackStore(boost::filesystem::path dirPath);
+    ~PackStore();
+
+    /// Check if the pack was kept by an earlier run
+    bool isCached(const SmallFilePack& pack) const;
+    /// Use the pack for updating the files in it. It is downloaded by download of the channel listing it if required
+    void add(const SmallFilePack& pack, Download download);
+    /// Get an added pack containing the file with the hash or nullptr
+    const SmallFilePack* find(const std::string& hash) const;
+    /// Write the file with the hash from the pack to filePath. Return false if the pack can't be loaded
+    bool extract(const SmallFilePack& pack, const std::string& hash, const boost::filesystem::path& filePath);
+    /// Remove kept packs which were not added in this run
+    void removeUnused();
+
+private:
+    struct AddedPack
+    {
+        const SmallFilePack* pack;
+        Download download;
+    };
+
+    boost::filesystem::path dirPath_;
+    std::vector<AddedPack> packs_;
+    /// Whether the kept pack is usable by the digest of the pack, set on first use
+    std::unordered_map<std::string, bool> loadedPacks_;
+
+    /// Make sure the pack is kept and valid, downloading it if required. Return false if that failed
+    bool load(const SmallFilePack& pack);
+    bool verifyPack(const SmallFilePack& pack) const;
+};
@@ -0,0 +1,119 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "stagedFile.h"
+#include <boost/filesystem.hpp>
+#include <boost/nowide/cstdio.hpp>
+#include <stdexcept>
+#include <string>
+#ifdef __linux__
+#    include <fcntl.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace bfs = boost::filesystem;
+namespace bnw = boost::nowide;
+
+namespace {
+/// Random name next to the target, so other processes updating the same installation use different ones
+bfs::path getTemporaryPath(const bfs::path& targetPath)
+{
+    bfs::path tmpPath = targetPath;
+    tmpPath += ".new-" + bfs::unique_path().string();
+    return tmpPath;
+}
+} // namespace
+
+StagedFile::StagedFile(bfs::path targetPath) : targetPath_(std::move(targetPath))
+{
+#if defined(__linux__) && defined(O_TMPFILE)
+    fd_ = open(targetPath_.parent_path().c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0644);
+    // Not all filesystems support unnamed files
+    if(fd_ >= 0)
+    {
+        path_ = "/proc/self/fd/" + std::to_string(fd_);
+        return;
+    }
+#endif
+    path_ = getTemporaryPath(targetPath_);
+    // Create it exclusively, so only a file created here is removed again
+    FILE* fp = bnw::fopen(path_.string().c_str(), "wbx");
+    if(!fp)
+        throw std::runtime_error("Failed to create " + path_.string());
+    fclose(fp);
+}
+
+StagedFile::~StagedFile()
+{
+#ifdef __linux__
+    // An unnamed file is freed on closing
+    if(fd_ >= 0)
+        close(fd_);
+#endif
+    if(fd_ < 0 && !committed_)
+    {
+        boost::system::error_code ec;
+        bfs::remove(path_, ec);
+    }
+}
+
+void StagedFile::commit()
+{
+    boost::system::error_code ec;
+    const auto targetStatus = bfs::status(targetPath_, ec);
+    if(bfs::exists(targetStatus))
+        bfs::permissions(path_, targetStatus.permissions(), ec);
+
+#ifdef __linux__
+    // The content must be on disk before it replaces the old file
+    const int syncFd = fd_ >= 0 ? fd_ : open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    const bool synced = syncFd >= 0 && fsync(syncFd) == 0;
+    if(syncFd >= 0 && syncFd != fd_)
+        close(syncFd);
+    if(!synced)
+        throw std::runtime_error("Failed to write new content of " + targetPath_.string() + " to disk");
+#endif
+    if(fd_ < 0)
+        replaceTarget(path_);
+#ifdef __linux__
+    else
+    {
+        // An unnamed file can only be linked to a new name, which is then renamed over the target
+        // Linking fails instead of replacing an existing file
+        const bfs::path tmpPath = getTemporaryPath(targetPath_);
+        if(linkat(AT_FDCWD, path_.c_str(), AT_FDCWD, tmpPath.c_str(), AT_SYMLINK_FOLLOW) != 0)
+            throw std::runtime_error("Failed to link new content of " + targetPath_.string());
+        try
+        {
+            replaceTarget(tmpPath);
+        } catch(...)
+        {
+            bfs::remove(tmpPath, ec);
+            throw;
+        }
+    }
+#endif
+    committed_ = true;
+}
+
+void StagedFile::replaceTarget(const bfs::path& srcPath)
+{
+    boost::system::error_code ec;
+    bfs::rename(srcPath, targetPath_, ec);
+#ifdef _WIN32
+    // Files in use can't be replaced, but moved out of the way
+    if(ec)
+    {
+        bfs::path bakFilePath(targetPath_);
+        bakFilePath += ".bak";
+        bfs::rename(targetPath_, bakFilePath, ec);
+        if(ec)
+            throw std::runtime_error("failed to move blocked file " + targetPath_.string() + " out of the way ...");
+        bfs::rename(srcPath, targetPath_, ec);
+    }
+#endif
+    if(ec)
+        throw std::runtime_error("Failed to replace " + targetPath_.string() + ": " + ec.message());
+}
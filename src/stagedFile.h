@@ -0,0 +1,35 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+/// New content of a file which replaces the file atomically once it is complete.
+/// On Linux the content is staged in an unnamed file (O_TMPFILE) in the target directory, so nothing is left behind
+/// if the process dies. Elsewhere a temporary file with a random name next to the target is created, throwing on
+/// error, and removed unless committed.
+class StagedFile
+{
+public:
+    explicit StagedFile(boost::filesystem::path targetPath);
+    ~StagedFile();
+    StagedFile(const StagedFile&) = delete;
+    StagedFile& operator=(const StagedFile&) = delete;
+
+    /// Path for writing the content. May be opened multiple times, e.g. for writing in parallel
+    const boost::filesystem::path& getPath() const { return path_; }
+    /// Flush the content to disk and replace the target by it, keeping the permissions of the old file. Throws on error
+    void commit();
+
+private:
+    boost::filesystem::path targetPath_;
+    boost::filesystem::path path_;
+    /// Descriptor of the unnamed file or -1 if a named temporary file is used
+    int fd_ = -1;
+    bool committed_ = false;
+
+    /// Replace the target by the named file at srcPath
+    void replaceTarget(const boost::filesystem::path& srcPath);
+};
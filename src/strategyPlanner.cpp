@@ -0,0 +1,212 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "strategyPlanner.h"
+#include <boost/filesystem.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <string>
+
+namespace bfs = boost::filesystem;
+namespace bnw = boost::nowide;
+
+namespace {
+/// Weight of a new measurement
+constexpr double smoothing = 0.2;
+/// Transfers smaller than this are dominated by the latency and not used for the bandwidth
+constexpr uint64_t minBandwidthSample = 64 * 1024;
+/// The ratio of small files is dominated by the format overhead
+constexpr uint64_t minCompressionSample = 4 * 1024;
+constexpr std::array<const char*, numUpdateStrategies> strategyNames = {
+  "local copy", "chunk repair", "delta patch", "small-file pack", "seekable download", "full download"};
+
+void smooth(double& value, double sample)
+{
+    value += smoothing * (sample - value);
+}
+} // namespace
+
+const char* getStrategyName(UpdateStrategy strategy)
+{
+    return strategyNames[static_cast<size_t>(strategy)];
+}
+
+void StrategyPlanner::load(const bfs::path& filePath)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    filePath_ = filePath;
+    bnw::ifstream file(filePath_);
+    // Format: <name> <value>, unknown and invalid values are ignored
+    std::string name;
+    double value;
+    while(file >> name >> value)
+    {
+        if(!(value > 0))
+            continue;
+        if(name == "bandwidth")
+            bandwidth_ = value;
+        else if(name == "latency")
+            latency_ = value;
+        else if(name == "decompression")
+            decompressionRate_ = value;
+        else if(name == "copy")
+            copyRate_ = value;
+        else if(name == "compression")
+            compressionRatio_ = value;
+        for(size_t i = 0; i < numUpdateStrategies; i++)
+        {
+            if(name == std::string("correction.") + std::to_string(i))
+                correction_[i] = value;
+        }
+    }
+}
+
+bool StrategyPlanner::save() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(filePath_.empty())
+        return true;
+    bfs::path tmpPath = filePath_;
+    tmpPath += ".new";
+    {
+        bnw::ofstream file(tmpPath);
+        file << std::setprecision(6) << "bandwidth " << bandwidth_ << "\nlatency " << latency_ << "\ndecompression "
+             << decompressionRate_ << "\ncopy " << copyRate_ << "\ncompression " << compressionRatio_ << "\n";
+        for(size_t i = 0; i < numUpdateStrategies; i++)
+            file << "correction." << i << " " << correction_[i] << "\n";
+        if(!file.flush())
+            return false;
+    }
+    boost::system::error_code ec;
+    bfs::rename(tmpPath, filePath_, ec);
+    return !ec;
+}
+
+void StrategyPlanner::addTransfer(uint64_t bytes, double seconds, double latency)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(latency > 0)
+        smooth(latency_, latency);
+    if(bytes >= minBandwidthSample && seconds > latency)
+        smooth(bandwidth_, bytes / (seconds - latency));
+}
+
+void StrategyPlanner::addDecompression(uint64_t bytes, double seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(bytes > 0 && seconds > 0)
+        smooth(decompressionRate_, bytes / seconds);
+}
+
+void StrategyPlanner::addCopy(uint64_t bytes, double seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(bytes > 0 && seconds > 0)
+        smooth(copyRate_, bytes / seconds);
+}
+
+void StrategyPlanner::addCompression(uint64_t compressedBytes, uint64_t decompressedBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(compressedBytes > 0 && decompressedBytes >= minCompressionSample)
+        smooth(compressionRatio_, static_cast<double>(compressedBytes) / decompressedBytes);
+}
+
+void StrategyPlanner::addResult(UpdateStrategy strategy, double estimatedSeconds, double actualSeconds)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto idx = static_cast<size_t>(strategy);
+    totals_[idx].count++;
+    totals_[idx].estimatedSeconds += estimatedSeconds;
+    totals_[idx].actualSeconds += actualSeconds;
+    // The estimate already contains the correction, so correct it by the remaining error
+    if(estimatedSeconds > 0 && actualSeconds > 0)
+    {
+        smooth(correction_[idx], correction_[idx] * actualSeconds / estimatedSeconds);
+        // Single outliers, e.g. a stalled transfer, must not disable a strategy
+        correction_[idx] = std::min(std::max(correction_[idx], 0.1), 10.0);
+    }
+}
+
+std::vector<StrategyCost> StrategyPlanner::plan(const FileUpdateInfo& info, unsigned numThreads) const
+{
+    std::vector<StrategyCost> result;
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto addStrategy = [&](UpdateStrategy strategy) {
+        const double correction = correction_[static_cast<size_t>(strategy)];
+        result.push_back({strategy, estimate(strategy, info, numThreads) * correction});
+    };
+    if(info.hasLocalCopy)
+        addStrategy(UpdateStrategy::LocalCopy);
+    if(info.numRepairRanges > 0)
+        addStrategy(UpdateStrategy::ChunkRepair);
+    if(info.deltaSize > 0)
+        addStrategy(UpdateStrategy::Delta);
+    if(info.hasPackEntry)
+        addStrategy(UpdateStrategy::Pack);
+    if(info.hasSeekablePayload)
+        addStrategy(UpdateStrategy::Seekable);
+    addStrategy(UpdateStrategy::Full);
+    std::stable_sort(result.begin(), result.end(),
+                     [](const StrategyCost& lhs, const StrategyCost& rhs) { return lhs.seconds < rhs.seconds; });
+    return result;
+}
+
+bool StrategyPlanner::isPackCheaper(uint64_t packSize, size_t numFiles, uint64_t filesSize) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Packs usually compress better than their files, which is ignored here
+    const double packCost = latency_ + packSize * compressionRatio_ / bandwidth_;
+    const double filesCost = numFiles * latency_ + filesSize * compressionRatio_ / bandwidth_;
+    return packCost < filesCost;
+}
+
+void StrategyPlanner::printStats(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(size_t i = 0; i < numUpdateStrategies; i++)
+    {
+        const Totals& totals = totals_[i];
+        if(totals.count == 0)
+            continue;
+        out << "Strategy " << std::left << std::setw(17) << strategyNames[i] << std::right << std::setw(5)
+            << totals.count << " files, estimated " << std::fixed << std::setprecision(2) << totals.estimatedSeconds
+            << "s, actual " << totals.actualSeconds << "s" << std::endl;
+    }
+    out << "Measured bandwidth " << std::fixed << std::setprecision(0) << bandwidth_ / 1024 << " KiB/s, latency "
+        << std::setprecision(3) << latency_ << "s, decompression " << std::setprecision(0)
+        << decompressionRate_ / 1024 << " KiB/s per thread" << std::endl;
+}
+
+double StrategyPlanner::estimate(UpdateStrategy strategy, const FileUpdateInfo& info, unsigned numThreads) const
+{
+    const double size = static_cast<double>(info.size);
+    const double transfer = size * compressionRatio_ / bandwidth_;
+    switch(strategy)
+    {
+        case UpdateStrategy::LocalCopy: return size / copyRate_;
+        case UpdateStrategy::ChunkRepair:
+            // One request for the seek table and one per range
+            return (info.numRepairRanges + 1) * latency_ + info.repairBytes / bandwidth_;
+        case UpdateStrategy::Delta:
+            // The patch is compressed already and applied at about the speed of a copy
+            return latency_ + info.deltaSize / bandwidth_ + size / copyRate_;
+        case UpdateStrategy::Pack:
+            // The request for the pack is shared by all of its files
+            return transfer + size / copyRate_;
+        case UpdateStrategy::Seekable:
+            return latency_ + transfer + size / (decompressionRate_ * std::max(1u, numThreads));
+        case UpdateStrategy::Full:
+            // Decompression runs while downloading
+            return latency_ + std::max(transfer, size / decompressionRate_);
+    }
+    return 0;
+}
+
+StrategyPlanner& getStrategyPlanner()
+{
+    static StrategyPlanner planner;
+    return planner;
+}
@@ -0,0 +1,107 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/// Ways to obtain the new content of a file, in the order they are preferred at equal cost
+enum class UpdateStrategy
+{
+    /// Copy from another installation or the object cache
+    LocalCopy,
+    /// Download only the corrupt chunks
+    ChunkRepair,
+    /// Download a patch from the current to the new version
+    Delta,
+    /// Extract from a pack of small files, which is downloaded once for all of them
+    Pack,
+    /// Download the seekable payload and decompress its frames in parallel
+    Seekable,
+    /// Download the bzip2 payload and decompress it while receiving
+    Full
+};
+constexpr size_t numUpdateStrategies = 6;
+
+const char* getStrategyName(UpdateStrategy strategy);
+
+/// What is known about an outdated file before updating it
+struct FileUpdateInfo
+{
+    /// Expected size of the new file
+    uint64_t size = 0;
+    bool hasLocalCopy = false;
+    bool hasSeekablePayload = false;
+    /// The file is contained in a pack used by this run
+    bool hasPackEntry = false;
+    /// Uncompressed bytes and number of byte ranges to fetch for a chunk repair, 0 if not possible
+    uint64_t repairBytes = 0;
+    size_t numRepairRanges = 0;
+    /// Size of the patch from the current version, 0 if there is none
+    uint64_t deltaSize = 0;
+};
+
+/// Estimated cost of a strategy in seconds
+struct StrategyCost
+{
+    UpdateStrategy strategy;
+    double seconds;
+};
+
+/// Chooses the cheapest strategy for updating a file by estimating their costs from throughputs measured by this
+/// and earlier runs. Measurements are smoothed exponentially and stored between runs. Thread-safe
+class StrategyPlanner
+{
+public:
+    /// Load the values of earlier runs from the file, defaults are used if it does not exist
+    void load(const boost::filesystem::path& filePath);
+    bool save() const;
+
+    /// A download of bytes which took seconds, of which latency passed until the first byte arrived
+    void addTransfer(uint64_t bytes, double seconds, double latency);
+    /// bytes were written by decompressing with one thread for seconds
+    void addDecompression(uint64_t bytes, double seconds);
+    /// bytes were copied locally in seconds
+    void addCopy(uint64_t bytes, double seconds);
+    void addCompression(uint64_t compressedBytes, uint64_t decompressedBytes);
+    /// A strategy estimated to take estimatedSeconds took actualSeconds
+    void addResult(UpdateStrategy strategy, double estimatedSeconds, double actualSeconds);
+
+    /// Estimate the cost of all possible strategies for the file, cheapest first
+    std::vector<StrategyCost> plan(const FileUpdateInfo& info, unsigned numThreads) const;
+    /// Check if downloading a pack of packSize is cheaper than downloading numFiles of it with filesSize separately
+    bool isPackCheaper(uint64_t packSize, size_t numFiles, uint64_t filesSize) const;
+    /// Print estimated and actual costs of the strategies used in this run
+    void printStats(std::ostream& out) const;
+
+private:
+    struct Totals
+    {
+        size_t count = 0;
+        double estimatedSeconds = 0;
+        double actualSeconds = 0;
+    };
+
+    mutable std::mutex mutex_;
+    boost::filesystem::path filePath_;
+    double bandwidth_ = 2e6;
+    double latency_ = 0.1;
+    double decompressionRate_ = 20e6;
+    double copyRate_ = 200e6;
+    double compressionRatio_ = 0.5;
+    /// Ratio of actual to estimated cost per strategy, corrects systematic errors of the model
+    std::array<double, numUpdateStrategies> correction_ = {1, 1, 1, 1, 1, 1};
+    std::array<Totals, numUpdateStrategies> totals_;
+
+    double estimate(UpdateStrategy strategy, const FileUpdateInfo& info, unsigned numThreads) const;
+};
+
+/// Planner shared by all stages of the process
+StrategyPlanner& getStrategyPlanner();
@@ -0,0 +1,189 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include "bz2Decompressor.h"
+#include "deltaPatch.h"
+#include "memoryBudget.h"
+#include "objectPool.h"
+#include "writeThrottle.h"
+#include <array>
+#include <bzlib.h>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+
+/// Buffer for reading and writing files
+using IoBuffer = std::array<char, 256 * 1024>;
+
+/// Buffers shared by all stages of the process
+inline ObjectPool<IoBuffer>& getIoBufferPool()
+{
+    static ObjectPool<IoBuffer> pool;
+    return pool;
+}
+
+/// Stages processing the data of a transfer, e.g. Bz2Decompress<HashTee<Blake3, StreamWriter>>.
+/// Each stage provides `bool write(const char* data, size_t size)` passing the data on to the next stage and
+/// `bool finish()` checking that the data is complete. The stages are composed at compile time, so the whole
+/// chain is inlined into a single write callback without virtual calls or intermediate copies.
+/// Stages taking a next stage forward their constructor arguments to it.
+namespace sink {
+
+/// Last stage writing to a stream
+class StreamWriter
+{
+public:
+    explicit StreamWriter(std::ostream& stream) : stream_(stream) {}
+    bool write(const char* data, size_t size) { return static_cast<bool>(stream_.write(data, size)); }
+    bool finish() { return static_cast<bool>(stream_.flush()); }
+
+private:
+    std::ostream& stream_;
+};
+
+/// Last stage appending to a string. The received data is reserved from the memory budget
+class MemoryWriter
+{
+public:
+    explicit MemoryWriter(std::string& data) : data_(data), lease_(getMemoryBudget()) {}
+    bool write(const char* data, size_t size)
+    {
+        // Stalls the transfer while other stages hold the memory
+        lease_.resize(data_.size() + size);
+        data_.append(data, size);
+        return true;
+    }
+    bool finish() { return true; }
+
+private:
+    std::string& data_;
+    MemoryBudget::Lease lease_;
+};
+
+/// Hash the data passing through with T_Hash (Blake3 or Md5Hash)
+template<class T_Hash, class T_Next>
+class HashTee
+{
+public:
+    template<class... T_Args>
+    explicit HashTee(T_Args&&... args) : next_(std::forward<T_Args>(args)...)
+    {}
+    bool write(const char* data, size_t size)
+    {
+        hash_.update(data, size);
+        return next_.write(data, size);
+    }
+    bool finish() { return next_.finish(); }
+    /// Hex digest of all data passed so far
+    std::string getDigest() const { return hash_.toString(); }
+    T_Next& next() { return next_; }
+
+private:
+    T_Hash hash_;
+    T_Next next_;
+};
+
+/// Limit the rate at which the data is passed on to the write throttle of the process.
+/// Takes the path of the file written by the next stage in front of the arguments of the next stage
+template<class T_Next>
+class Throttle
+{
+public:
+    template<class... T_Args>
+    explicit Throttle(const boost::filesystem::path& filePath, T_Args&&... args)
+        : next_(std::forward<T_Args>(args)...), file_(getWriteThrottle(), filePath)
+    {}
+    bool write(const char* data, size_t size)
+    {
+        file_.reserve(size);
+        return next_.write(data, size);
+    }
+    bool finish() { return next_.finish(); }
+    T_Next& next() { return next_; }
+
+private:
+    T_Next next_;
+    WriteThrottle::File file_;
+};
+
+/// Apply the received delta patch to the old file, passing the new contents on.
+/// Takes the path of the old file in front of the arguments of the next stage
+template<class T_Next>
+class DeltaApply
+{
+public:
+    template<class... T_Args>
+    explicit DeltaApply(const boost::filesystem::path& oldFilePath, T_Args&&... args)
+        : next_(std::forward<T_Args>(args)...), decoder_(oldFilePath)
+    {}
+    bool write(const char* data, size_t size)
+    {
+        return decoder_.write(data, size, next_);
+    }
+    bool finish() { return decoder_.isFinished() && next_.finish(); }
+    T_Next& next() { return next_; }
+
+private:
+    T_Next next_;
+    delta::Decoder decoder_;
+};
+
+/// Decompress a bzip2 stream. Decompressor and buffer are taken from the pools
+template<class T_Next>
+class Bz2Decompress
+{
+public:
+    template<class... T_Args>
+    explicit Bz2Decompress(T_Args&&... args)
+        : next_(std::forward<T_Args>(args)...), decompressor_(getBz2DecompressorPool().acquire()),
+          buffer_(getIoBufferPool().acquire()), lease_(getMemoryBudget(), buffer_->size())
+    {
+        status_ = decompressor_->begin() ? BZ_OK : BZ_MEM_ERROR;
+    }
+    bool write(const char* data, size_t size)
+    {
+        compressedSize_ += size;
+        // Data after the end of the stream is ignored
+        while(status_ == BZ_OK)
+        {
+            char* output = buffer_->data();
+            size_t outputSize = buffer_->size();
+            status_ = decompressor_->decompress(data, size, output, outputSize);
+            const size_t numDecompressed = output - buffer_->data();
+            decompressedSize_ += numDecompressed;
+            if(numDecompressed > 0 && !next_.write(buffer_->data(), numDecompressed))
+                return false;
+            // A partially filled buffer means all input was consumed
+            if(size == 0 && outputSize > 0)
+                break;
+        }
+        return status_ == BZ_OK || status_ == BZ_STREAM_END;
+    }
+    bool finish() { return status_ == BZ_STREAM_END && next_.finish(); }
+    T_Next& next() { return next_; }
+    uint64_t getCompressedSize() const { return compressedSize_; }
+    uint64_t getDecompressedSize() const { return decompressedSize_; }
+
+private:
+    T_Next next_;
+    ObjectPool<Bz2Decompressor>::Handle decompressor_;
+    ObjectPool<IoBuffer>::Handle buffer_;
+    MemoryBudget::Lease lease_;
+    int status_;
+    uint64_t compressedSize_ = 0, decompressedSize_ = 0;
+};
+
+/// curl write callback passing the data to the stage given as user data
+template<class T_Stage>
+size_t curlWrite(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    const size_t realsize = size * nmemb;
+    return static_cast<T_Stage*>(userdata)->write(ptr, realsize) ? realsize : 0;
+}
+
+} // namespace sink
@@ -0,0 +1,81 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "updateJournal.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <utility>
+
+namespace bfs = boost::filesystem;
+namespace bnw = boost::nowide;
+
+namespace {
+constexpr auto journalHeader = "s25update-journal 1 ";
+// Files found up to date were recorded as 'V' by older versions, such lines are skipped
+constexpr std::array<char, 3> stepNames = {'D', 'E', 'C'};
+} // namespace
+
+UpdateJournal::UpdateJournal(bfs::path filePath, const std::string& manifestHash)
+    : filePath_(std::move(filePath)), header_(journalHeader + manifestHash)
+{
+    bool resume = false;
+    {
+        std::stringstream contents;
+        bnw::ifstream oldFile(filePath_, std::ios::binary);
+        if(oldFile)
+            contents << oldFile.rdbuf();
+        std::string line;
+        resume = getline(contents, line) && line == header_;
+        // Format: <step> <path>. Ignore incomplete lines of an interrupted write
+        while(resume && getline(contents, line) && !contents.eof())
+        {
+            if(line.size() < 3 || line[1] != ' ')
+                continue;
+            const auto itStep = std::find(stepNames.begin(), stepNames.end(), line[0]);
+            if(itStep != stepNames.end())
+                steps_[line.substr(2)] = static_cast<JournalStep>(itStep - stepNames.begin());
+        }
+    }
+
+    if(resume)
+        file_.open(filePath_, std::ios::binary | std::ios::app);
+    else
+    {
+        file_.open(filePath_, std::ios::binary | std::ios::trunc);
+        file_ << header_ << '\n' << std::flush;
+    }
+}
+
+boost::optional<JournalStep> UpdateJournal::getStep(const std::string& path) const
+{
+    const auto it = steps_.find(path);
+    if(it == steps_.end())
+        return boost::none;
+    return it->second;
+}
+
+void UpdateJournal::record(const std::string& path, JournalStep step)
+{
+    std::lock_guard<std::mutex> lock(fileMutex_);
+    if(!file_.is_open())
+    {
+        file_.clear();
+        file_.open(filePath_, std::ios::binary | std::ios::trunc);
+        file_ << header_ << '\n';
+    }
+    if(!file_)
+        return;
+    file_ << stepNames[static_cast<unsigned>(step)] << ' ' << path << '\n' << std::flush;
+}
+
+void UpdateJournal::finish()
+{
+    std::lock_guard<std::mutex> lock(fileMutex_);
+    file_.close();
+    steps_.clear();
+    boost::system::error_code ec;
+    bfs::remove(filePath_, ec);
+}
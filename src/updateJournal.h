@@ -0,0 +1,49 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <boost/nowide/fstream.hpp>
+#include <boost/optional.hpp>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/// Steps of updating a file in the order they happen
+enum class JournalStep
+{
+    /// Compressed file was downloaded completely
+    Downloaded,
+    /// File was written
+    Extracted,
+    /// Temporary files were removed, nothing left to do
+    Committed
+};
+
+/// Append-only log of the completed steps of an update run.
+/// If a run is interrupted the next run for the same manifest can continue where it stopped.
+class UpdateJournal
+{
+public:
+    /// Open the journal for the manifest with the given hash.
+    /// Entries are only loaded if they were written for the same manifest, otherwise a new journal is started.
+    UpdateJournal(boost::filesystem::path filePath, const std::string& manifestHash);
+
+    /// True if entries of a previous run were loaded
+    bool isResumed() const { return !steps_.empty(); }
+    /// Get the last step recorded for the file
+    boost::optional<JournalStep> getStep(const std::string& path) const;
+    /// Record a completed step and flush it to disk. Thread-safe
+    void record(const std::string& path, JournalStep step);
+    /// Remove the journal after the update finished successfully. Steps recorded afterwards start a new journal
+    void finish();
+
+private:
+    boost::filesystem::path filePath_;
+    std::string header_;
+    std::mutex fileMutex_;
+    boost::nowide::ofstream file_;
+    std::unordered_map<std::string, JournalStep> steps_;
+};
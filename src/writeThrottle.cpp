@@ -0,0 +1,92 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "writeThrottle.h"
+#include <algorithm>
+#include <thread>
+#ifdef __linux__
+#    include <fcntl.h>
+#    include <unistd.h>
+#endif
+
+namespace {
+/// Writes may burst for this long after being idle
+constexpr double maxBurstSeconds = 0.25;
+} // namespace
+
+WriteThrottle::File::File(WriteThrottle& throttle, const boost::filesystem::path& filePath) : throttle_(throttle)
+{
+#ifdef __linux__
+    // A separate descriptor refers to the same page cache, so the writer can keep using a stream
+    if(throttle_.syncInterval_ > 0)
+        fd_ = ::open(filePath.c_str(), O_WRONLY | O_CLOEXEC);
+#else
+    (void)filePath;
+#endif
+}
+
+WriteThrottle::File::~File()
+{
+#ifdef __linux__
+    if(fd_ >= 0)
+        ::close(fd_);
+#endif
+}
+
+void WriteThrottle::File::reserve(uint64_t size)
+{
+    throttle_.acquire(size);
+#ifdef __linux__
+    const uint64_t syncInterval = throttle_.syncInterval_;
+    if(fd_ < 0 || syncInterval == 0)
+        return;
+    // Data passed to reserve before is written by now except for what the stream still buffers
+    if(unsyncedSize_.fetch_add(size) + size >= syncInterval)
+    {
+        unsyncedSize_ = 0;
+        // Wait for the write-back of the whole file, which limits its dirty pages to about one interval
+        ::sync_file_range(fd_, 0, 0,
+                          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+#endif
+}
+
+void WriteThrottle::setRate(uint64_t rate)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    rate_ = rate;
+    tokens_ = 0;
+    lastRefill_ = Clock::now();
+}
+
+void WriteThrottle::setSyncInterval(uint64_t syncInterval)
+{
+    syncInterval_ = syncInterval;
+}
+
+void WriteThrottle::acquire(uint64_t size)
+{
+    std::chrono::duration<double> delay(0);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(rate_ == 0)
+            return;
+        const Clock::time_point now = Clock::now();
+        const std::chrono::duration<double> elapsed = now - lastRefill_;
+        lastRefill_ = now;
+        tokens_ = std::min(tokens_ + elapsed.count() * rate_, rate_ * maxBurstSeconds);
+        // Taking the tokens before waiting queues the writers in the order they arrived
+        tokens_ -= static_cast<double>(size);
+        if(tokens_ < 0)
+            delay = std::chrono::duration<double>(-tokens_ / rate_);
+    }
+    if(delay.count() > 0)
+        std::this_thread::sleep_for(delay);
+}
+
+WriteThrottle& getWriteThrottle()
+{
+    static WriteThrottle throttle;
+    return throttle;
+}
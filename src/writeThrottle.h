@@ -0,0 +1,57 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/// Limit for the rate at which all threads write to disk, so large updates don't stall the I/O of other processes.
+/// Writers take tokens from a bucket refilled at the rate before writing and wait while it is empty.
+class WriteThrottle
+{
+public:
+    /// Output file of a writer. Its dirty pages are written back after every sync interval,
+    /// so the page cache does not accumulate data which is then written in a single burst
+    class File
+    {
+    public:
+        File(WriteThrottle& throttle, const boost::filesystem::path& filePath);
+        ~File();
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
+
+        /// Wait until size bytes may be written. Thread-safe
+        void reserve(uint64_t size);
+
+    private:
+        WriteThrottle& throttle_;
+        int fd_ = -1;
+        std::atomic<uint64_t> unsyncedSize_{0};
+    };
+
+    /// Set the rate in bytes per second, 0 for unlimited
+    void setRate(uint64_t rate);
+    /// Set the number of bytes after which the dirty pages of a file are written back, 0 to disable
+    void setSyncInterval(uint64_t syncInterval);
+
+    /// Wait until size bytes may be written. Sizes larger than the bucket are allowed and delay later writers
+    void acquire(uint64_t size);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex mutex_;
+    uint64_t rate_ = 0;
+    std::atomic<uint64_t> syncInterval_{0};
+    /// Available bytes, negative if writers already took more than was available
+    double tokens_ = 0;
+    Clock::time_point lastRefill_;
+};
+
+/// Throttle shared by all writers of the process, unlimited by default
+WriteThrottle& getWriteThrottle();
@@ -0,0 +1,36 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "allocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<size_t> numAllocations{0};
+} // namespace
+
+size_t getNumAllocations()
+{
+    return numAllocations;
+}
+
+// The replaced operators count all allocations of the test process, new[] and the other forms use these ones
+void* operator new(std::size_t size)
+{
+    numAllocations++;
+    if(void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
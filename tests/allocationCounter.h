@@ -0,0 +1,10 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#pragma once
+
+#include <cstddef>
+
+/// Number of heap allocations by operator new in the test process so far
+size_t getNumAllocations();
@@ -0,0 +1,180 @@
+# Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+"""Scalability benchmark of the updater for builds with very many files.
+
+Generates a file list with the given number of entries and a matching installation of small files of which every
+1000th one is outdated. The installation is updated from a local server and the phase times and the peak memory
+reported by --stats are compared to the stored baseline of the same number of files. Fails if any of them
+regressed by more than the tolerance. The best result of all runs is used.
+
+Usage: benchManifest.py <path to s25update> [options]
+"""
+
+import argparse
+import bz2
+import hashlib
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+from chaosServer import ChaosServer
+
+PLATFORM_PATH = "s25client/nightly/linux.x86_64/updater"
+OUTDATED_INTERVAL = 1000
+# Compared phases and the peak memory in KiB
+METRICS = ["parsing", "metadata scan", "verification", "planning", "peak memory"]
+# Differences of short phases below this are measurement noise
+MIN_TIME_DIFFERENCE = 0.05
+STATE_FILES = [".s25update-cache", ".s25update-journal", ".s25update-planner"]
+
+
+def getFilePath(idx):
+    return "share/s25rttr/d%03d/e%02d/f%07d.txt" % (idx // 10000, idx // 100 % 100, idx)
+
+
+def getContents(idx):
+    return b"file %d\n" % idx
+
+
+def generate(workDir, numFiles):
+    """Create the published build and the installation unless they exist for the number of files"""
+    markerPath = os.path.join(workDir, "generated.json")
+    if os.path.exists(markerPath):
+        with open(markerPath) as markerFile:
+            if json.load(markerFile).get("numFiles") == numFiles:
+                return
+    shutil.rmtree(workDir, ignore_errors=True)
+    print("Generating %d files in %s" % (numFiles, workDir), flush=True)
+    updaterPath = os.path.join(workDir, "www", PLATFORM_PATH)
+    installPath = os.path.join(workDir, "install")
+    lines = []
+    for idx in range(numFiles):
+        path = getFilePath(idx)
+        data = getContents(idx)
+        if idx % 100 == 0:
+            os.makedirs(os.path.dirname(os.path.join(installPath, path)))
+        with open(os.path.join(installPath, path), "wb") as file:
+            file.write(data)
+        lines.append("%s  ./%s\n" % (hashlib.md5(data).hexdigest(), path))
+        if idx % OUTDATED_INTERVAL == 0:
+            payloadPath = os.path.join(updaterPath, path) + ".bz2"
+            os.makedirs(os.path.dirname(payloadPath), exist_ok=True)
+            with open(payloadPath, "wb") as file:
+                file.write(bz2.compress(data))
+    with open(os.path.join(updaterPath, "files"), "w") as fileList:
+        fileList.write("".join(lines))
+    with open(markerPath, "w") as markerFile:
+        json.dump({"numFiles": numFiles}, markerFile)
+
+
+def resetInstallation(installPath, numFiles):
+    """Outdate the same files and forget the state of previous runs so each run does the same work"""
+    for name in STATE_FILES:
+        if os.path.exists(os.path.join(installPath, name)):
+            os.remove(os.path.join(installPath, name))
+    for idx in range(0, numFiles, OUTDATED_INTERVAL):
+        with open(os.path.join(installPath, getFilePath(idx)), "wb") as file:
+            file.write(b"outdated\n")
+
+
+def runUpdater(updater, installPath, serverUrl, extraArgs):
+    cmd = [updater, "--dir", installPath, "--server", serverUrl + "/s25client", "--target", "linux"]
+    cmd += ["--arch", "x86_64", "--stats"] + extraArgs
+    result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = result.stdout.decode(errors="replace")
+    if result.returncode != 0:
+        sys.exit("Update failed:\n" + output)
+    metrics = {}
+    for line in output.splitlines():
+        match = re.match(r"Phase (.+?)\s+([\d.]+)s$", line)
+        if match:
+            metrics[match.group(1)] = float(match.group(2))
+        match = re.match(r"Peak process memory: (\d+) KiB", line)
+        if match:
+            metrics["peak memory"] = int(match.group(1))
+    missing = [name for name in METRICS if name not in metrics]
+    if missing:
+        sys.exit("Missing %s in the output:\n%s" % (", ".join(missing), output))
+    return metrics
+
+
+def formatMetric(name, value):
+    return "%d KiB" % value if name == "peak memory" else "%.3fs" % value
+
+
+def compare(result, baseline, timeTolerance, memoryTolerance):
+    """Print the result next to the baseline and return the regressed metrics"""
+    regressions = []
+    print("%-16s%14s%14s" % ("Metric", "result", "baseline"))
+    for name in METRICS:
+        print("%-16s%14s%14s" % (name, formatMetric(name, result[name]), formatMetric(name, baseline[name])))
+        if name == "peak memory":
+            regressed = result[name] > baseline[name] * memoryTolerance
+        else:
+            regressed = result[name] > baseline[name] * timeTolerance + MIN_TIME_DIFFERENCE
+        if regressed:
+            regressions.append(name)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("updater")
+    parser.add_argument("--files", type=int, default=1000000, help="number of entries in the file list")
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--work-dir", default="manifestBench", help="reused if it was generated for as many files")
+    parser.add_argument("--baseline", default=os.path.join(os.path.dirname(__file__), "manifestBaseline.json"))
+    parser.add_argument("--time-tolerance", type=float, default=1.5, help="allowed factor of the baseline times")
+    parser.add_argument("--memory-tolerance", type=float, default=1.2, help="allowed factor of the baseline memory")
+    parser.add_argument("--update-baseline", action="store_true", help="store the result as the new baseline")
+    parser.add_argument("updaterArgs", nargs="*", help="further arguments of the updater, given after --")
+    args = parser.parse_args()
+
+    workDir = os.path.abspath(args.work_dir)
+    installPath = os.path.join(workDir, "install")
+    generate(workDir, args.files)
+    result = {}
+    # The updater keeps the full path of each file, so it gets one which doesn't depend on the work dir
+    linkDir = tempfile.mkdtemp(prefix="s25bench")
+    try:
+        os.symlink(installPath, os.path.join(linkDir, "i"))
+        with ChaosServer(os.path.join(workDir, "www")) as server:
+            for _ in range(args.runs):
+                resetInstallation(installPath, args.files)
+                metrics = runUpdater(
+                    os.path.abspath(args.updater), os.path.join(linkDir, "i"), server.url, args.updaterArgs
+                )
+                for name in METRICS:
+                    result[name] = min(result.get(name, metrics[name]), metrics[name])
+    finally:
+        shutil.rmtree(linkDir)
+
+    baselines = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as baselineFile:
+            baselines = json.load(baselineFile)
+    key = str(args.files)
+    if args.update_baseline:
+        baselines[key] = result
+        with open(args.baseline, "w") as baselineFile:
+            json.dump(baselines, baselineFile, indent=4, sort_keys=True)
+            baselineFile.write("\n")
+        print("Stored baseline for %d files in %s" % (args.files, args.baseline))
+        return 0
+    if key not in baselines:
+        print(json.dumps(result, indent=4, sort_keys=True))
+        sys.exit("No baseline for %d files, store one with --update-baseline" % args.files)
+    regressions = compare(result, baselines[key], args.time_tolerance, args.memory_tolerance)
+    if regressions:
+        sys.exit("Regressed: " + ", ".join(regressions))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,231 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Handoff throughput and latency of the lock-free ring queue compared to a queue with a mutex and condition variables.
+// Usage: benchRingQueue [<number of items>]
+
+#include "ringQueue.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t queueCapacity = 1024;
+constexpr size_t batchSize = 32;
+
+/// Bounded queue using a mutex and condition variables as the baseline
+template<class T>
+class MutexQueue
+{
+public:
+    explicit MutexQueue(size_t capacity) : capacity_(capacity) {}
+
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this]() { return closed_ || items_.size() < capacity_; });
+        if(closed_)
+            return false;
+        items_.push_back(std::move(item));
+        lock.unlock();
+        notEmpty_.notify_one();
+        return true;
+    }
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+        if(items_.empty())
+            return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        notFull_.notify_one();
+        return true;
+    }
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+private:
+    const size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_, notFull_;
+    std::deque<T> items_;
+    bool closed_ = false;
+};
+
+/// Push the items of the producer one by one
+template<class T_Queue>
+void produce(T_Queue& queue, unsigned producerIdx, unsigned numProducers, uint64_t numItems)
+{
+    for(uint64_t item = producerIdx + 1; item <= numItems; item += numProducers)
+        queue.push(item);
+}
+
+/// Push the items of the producer in batches, waiting only if the queue is full
+void produceBatches(ringQueue::MpmcQueue<uint64_t>& queue, unsigned producerIdx, unsigned numProducers,
+                    uint64_t numItems)
+{
+    std::array<uint64_t, batchSize> batch;
+    uint64_t nextItem = producerIdx + 1;
+    while(nextItem <= numItems)
+    {
+        size_t count = 0;
+        for(; count < batch.size() && nextItem <= numItems; nextItem += numProducers)
+            batch[count++] = nextItem;
+        size_t numPushed = 0;
+        while(numPushed < count)
+        {
+            const size_t numBatchPushed = queue.pushBatch(batch.data() + numPushed, count - numPushed);
+            if(numBatchPushed == 0)
+                queue.push(batch[numPushed++]);
+            numPushed += numBatchPushed;
+        }
+    }
+}
+
+/// Pop items until the queue is closed, return their sum
+template<class T_Queue>
+uint64_t consume(T_Queue& queue)
+{
+    uint64_t sum = 0;
+    uint64_t item;
+    while(queue.pop(item))
+        sum += item;
+    return sum;
+}
+
+uint64_t consumeBatches(ringQueue::MpmcQueue<uint64_t>& queue)
+{
+    uint64_t sum = 0;
+    std::array<uint64_t, batchSize> batch;
+    while(true)
+    {
+        size_t count = queue.popBatch(batch.data(), batch.size());
+        if(count == 0)
+        {
+            if(!queue.pop(batch[0]))
+                break;
+            count = 1;
+        }
+        for(size_t i = 0; i < count; i++)
+            sum += batch[i];
+    }
+    return sum;
+}
+
+/// Move numItems from the producers to the consumers, return the number of items per second
+template<class T_Queue, class T_Produce, class T_Consume>
+double measureThroughput(unsigned numProducers, unsigned numConsumers, uint64_t numItems, const T_Produce& produceFn,
+                         const T_Consume& consumeFn)
+{
+    T_Queue queue(queueCapacity);
+    std::atomic<uint64_t> sum{0};
+    const auto startTime = Clock::now();
+    std::vector<std::thread> consumers;
+    for(unsigned i = 0; i < numConsumers; i++)
+        consumers.emplace_back([&]() { sum += consumeFn(queue); });
+    std::vector<std::thread> producers;
+    for(unsigned i = 0; i < numProducers; i++)
+        producers.emplace_back([&, i]() { produceFn(queue, i, numProducers, numItems); });
+    for(std::thread& producer : producers)
+        producer.join();
+    queue.close();
+    for(std::thread& consumer : consumers)
+        consumer.join();
+    const std::chrono::duration<double> duration = Clock::now() - startTime;
+    if(sum != numItems * (numItems + 1) / 2)
+        throw std::runtime_error("Items were lost or duplicated");
+    return numItems / duration.count();
+}
+
+/// Send an item back and forth between two threads, return the average time of a single handoff in seconds
+template<class T_Queue>
+double measureLatency(uint64_t numRoundTrips)
+{
+    T_Queue requests(queueCapacity), responses(queueCapacity);
+    std::thread echo([&]() {
+        uint64_t item;
+        while(requests.pop(item))
+            responses.push(item);
+    });
+    const auto startTime = Clock::now();
+    for(uint64_t i = 0; i < numRoundTrips; i++)
+    {
+        uint64_t item = i;
+        requests.push(item);
+        if(!responses.pop(item) || item != i)
+            throw std::runtime_error("Wrong response");
+    }
+    const std::chrono::duration<double> duration = Clock::now() - startTime;
+    requests.close();
+    echo.join();
+    return duration.count() / (2 * numRoundTrips);
+}
+
+void printResult(const std::string& name, double ringQueueResult, double mutexQueueResult, const char* unit)
+{
+    std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << ringQueueResult << std::setw(12) << mutexQueueResult << " " << unit << std::endl;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const uint64_t numItems = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+        using RingQueue = ringQueue::MpmcQueue<uint64_t>;
+        using BaselineQueue = MutexQueue<uint64_t>;
+
+        std::cout << std::left << std::setw(32) << "Benchmark" << std::right << std::setw(12) << "ring" << std::setw(12)
+                  << "mutex" << std::endl;
+        const unsigned numCores = std::max(1u, std::thread::hardware_concurrency());
+        for(const unsigned numThreads : {1u, 2u, std::max(4u, numCores / 2)})
+        {
+            const std::string name = std::to_string(numThreads) + "x" + std::to_string(numThreads) + " throughput";
+            const double baseline = measureThroughput<BaselineQueue>(numThreads, numThreads, numItems,
+                                                                     produce<BaselineQueue>, consume<BaselineQueue>);
+            printResult(name,
+                        measureThroughput<RingQueue>(numThreads, numThreads, numItems, produce<RingQueue>,
+                                                     consume<RingQueue>)
+                          / 1e6,
+                        baseline / 1e6, "M items/s");
+            // The baseline has no batch operations, so it is compared to the single item handoffs
+            printResult(
+              name + " (batches)",
+              measureThroughput<RingQueue>(numThreads, numThreads, numItems, produceBatches, consumeBatches) / 1e6,
+              baseline / 1e6, "M items/s");
+        }
+        const uint64_t numRoundTrips = std::max<uint64_t>(1, numItems / 20);
+        printResult("handoff latency", measureLatency<RingQueue>(numRoundTrips) * 1e6,
+                    measureLatency<BaselineQueue>(numRoundTrips) * 1e6, "us");
+    } catch(const std::exception& e)
+    {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
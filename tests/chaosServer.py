@@ -0,0 +1,205 @@
+# Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+"""Local HTTP stand-in for the update server which injects network faults according to a scripted profile.
+
+A profile is a list of rules. A request uses the first rule whose "match" is contained in its path and gets the
+fault of "faults" at the position of the request among all requests of that path using the rule. Later requests
+are answered normally, or the faults start over if "repeat" is set. Faults:
+
+  ok                        answer normally
+  delay:<seconds>           wait before answering
+  slow:<bytes/s>            limit the bandwidth of the body
+  reset:<fraction>          send part of the body, then reset the connection
+  truncate:<fraction>       send part of the body, then close the connection
+  stall:<fraction>[:<sec>]  send part of the body, then stop sending for a while (default: until stopped)
+  norange                   ignore a requested range and send the whole file
+  429, 500, 502, 503, 504   answer with the error, overload responses ask to retry after 1s
+
+Usage as a script: chaosServer.py <root> [--port <port>] [--profile <json>]
+"""
+
+import argparse
+import http.server
+import json
+import os
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+
+
+class ChaosServer:
+    def __init__(self, root, profile=None, port=0):
+        self.root = os.path.realpath(root)
+        self.profile = profile or []
+        # Served requests as (path, range, fault)
+        self.requests = []
+        self._counts = {}
+        self._lock = threading.Lock()
+        self._stopped = threading.Event()
+        self._server = _HTTPServer(("127.0.0.1", port), _makeHandler(self))
+        self._server.daemon_threads = True
+        self._thread = None
+
+    @property
+    def port(self):
+        return self._server.server_address[1]
+
+    @property
+    def url(self):
+        return "http://127.0.0.1:%d" % self.port
+
+    def setProfile(self, profile):
+        with self._lock:
+            self.profile = profile
+            self.requests = []
+            self._counts = {}
+
+    def getFault(self, path, byteRange):
+        with self._lock:
+            fault = "ok"
+            for ruleIdx, rule in enumerate(self.profile):
+                if rule.get("match", "") not in path:
+                    continue
+                faults = rule.get("faults", [])
+                key = (ruleIdx, path)
+                count = self._counts.get(key, 0)
+                self._counts[key] = count + 1
+                if faults and rule.get("repeat", False):
+                    fault = faults[count % len(faults)]
+                elif count < len(faults):
+                    fault = faults[count]
+                break
+            self.requests.append((path, byteRange, fault))
+            return fault
+
+    def start(self):
+        self._thread = threading.Thread(target=self._server.serve_forever, daemon=True)
+        self._thread.start()
+        return self
+
+    def serveForever(self):
+        self._server.serve_forever()
+
+    def stop(self):
+        self._stopped.set()
+        self._server.shutdown()
+        self._server.server_close()
+
+    def __enter__(self):
+        return self.start()
+
+    def __exit__(self, *args):
+        self.stop()
+
+
+class _HTTPServer(http.server.ThreadingHTTPServer):
+    def handle_error(self, request, client_address):
+        # Clients abort connections e.g. after a timeout
+        if not isinstance(sys.exc_info()[1], ConnectionError):
+            super().handle_error(request, client_address)
+
+
+def _parseRange(byteRange, size):
+    """Return the first and last requested byte or None if the range is not satisfiable"""
+    match = re.match(r"bytes=(\d*)-(\d*)$", byteRange)
+    if not match or match.group(1) + match.group(2) == "":
+        return 0, size - 1
+    if match.group(1) == "":
+        return max(0, size - int(match.group(2))), size - 1
+    first = int(match.group(1))
+    last = min(int(match.group(2)), size - 1) if match.group(2) else size - 1
+    return (first, last) if first < size and first <= last else None
+
+
+def _makeHandler(server):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def log_message(self, format, *args):
+            pass
+
+        def sendEmpty(self, code, headers=()):
+            self.send_response(code)
+            for name, value in headers:
+                self.send_header(name, value)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+
+        def sendBody(self, body, kind, arg):
+            if kind in ("reset", "truncate", "stall"):
+                partArgs = arg.split(":")
+                self.wfile.write(body[: int(len(body) * float(partArgs[0]))])
+                self.wfile.flush()
+                self.close_connection = True
+                if kind == "reset":
+                    self.connection.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+                elif kind == "stall":
+                    server._stopped.wait(float(partArgs[1]) if len(partArgs) > 1 else None)
+                return
+            if kind == "slow":
+                # Send 10 pieces per second
+                pieceSize = max(1, int(arg) // 10)
+                for pos in range(0, len(body), pieceSize):
+                    self.wfile.write(body[pos : pos + pieceSize])
+                    self.wfile.flush()
+                    time.sleep(0.1)
+                return
+            self.wfile.write(body)
+
+        def do_GET(self):
+            path = self.path.split("?")[0]
+            byteRange = self.headers.get("Range")
+            fault = server.getFault(path, byteRange)
+            kind, _, arg = fault.partition(":")
+            if kind == "delay":
+                time.sleep(float(arg))
+            if kind.isdigit():
+                retryAfter = [("Retry-After", "1")] if kind in ("429", "503") else []
+                self.sendEmpty(int(kind), retryAfter)
+                return
+            filePath = os.path.join(server.root, path.lstrip("/"))
+            if not os.path.realpath(filePath).startswith(server.root + os.sep) or not os.path.isfile(filePath):
+                self.sendEmpty(404)
+                return
+            with open(filePath, "rb") as file:
+                data = file.read()
+            first, last, code = 0, len(data) - 1, 200
+            if byteRange and kind != "norange":
+                parsedRange = _parseRange(byteRange, len(data))
+                if parsedRange is None:
+                    self.sendEmpty(416, [("Content-Range", "bytes */%d" % len(data))])
+                    return
+                first, last = parsedRange
+                code = 206
+            body = data[first : last + 1]
+            self.send_response(code)
+            self.send_header("Content-Length", str(len(body)))
+            if code == 206:
+                self.send_header("Content-Range", "bytes %d-%d/%d" % (first, last, len(data)))
+            self.end_headers()
+            self.sendBody(body, kind, arg)
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Serve a directory with injected network faults")
+    parser.add_argument("root")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--profile", default="[]", help="JSON list of fault rules")
+    args = parser.parse_args()
+    server = ChaosServer(args.root, json.loads(args.profile), args.port)
+    print("Serving %s on %s" % (server.root, server.url), file=sys.stderr)
+    try:
+        server.serveForever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
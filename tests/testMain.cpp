@@ -0,0 +1,6 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#define BOOST_TEST_MODULE s25update
+#include <boost/test/unit_test.hpp>
@@ -0,0 +1,91 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "allocationCounter.h"
+#include "objectPool.h"
+#include "transferSink.h"
+#include <boost/test/unit_test.hpp>
+#include <bzlib.h>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+/// Last stage only counting the data
+struct CountingSink
+{
+    uint64_t size = 0;
+    bool write(const char*, size_t numBytes)
+    {
+        size += numBytes;
+        return true;
+    }
+    bool finish() { return true; }
+};
+
+std::string compress(std::string data)
+{
+    std::vector<char> compressed(data.size() + data.size() / 100 + 600);
+    auto compressedSize = static_cast<unsigned>(compressed.size());
+    if(BZ2_bzBuffToBuffCompress(compressed.data(), &compressedSize, &data[0], static_cast<unsigned>(data.size()), 9,
+                                0, 0)
+       != BZ_OK)
+        throw std::runtime_error("Compression failed");
+    return std::string(compressed.data(), compressedSize);
+}
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(ObjectPoolSuite)
+
+BOOST_AUTO_TEST_CASE(ReusesReleasedObjects)
+{
+    ObjectPool<int> pool(1);
+    const int* firstObject;
+    {
+        auto object = pool.acquire();
+        firstObject = object.get();
+        *object = 42;
+    }
+    auto object = pool.acquire();
+    BOOST_TEST(object.get() == firstObject);
+    // Objects are handed out in the state their last user left them
+    BOOST_TEST(*object == 42);
+    // Only one of them is kept
+    {
+        auto object2 = pool.acquire();
+        BOOST_TEST(object2.get() != firstObject);
+    }
+    object.reset();
+    BOOST_TEST(pool.acquire().get() != firstObject);
+}
+
+BOOST_AUTO_TEST_CASE(DecompressingPayloadsDoesNotAllocate)
+{
+    std::string data;
+    for(unsigned i = 0; data.size() < 1024 * 1024; i++)
+        data += "line " + std::to_string(i * 7919 % 100003) + "\n";
+    const std::string payload = compress(data);
+
+    // Decompress the payload like a transfer: In pieces as they are received
+    const auto decompress = [&payload]() {
+        sink::Bz2Decompress<CountingSink> pipeline;
+        bool ok = true;
+        for(size_t pos = 0; pos < payload.size(); pos += 16 * 1024)
+            ok &= pipeline.write(payload.data() + pos, std::min<size_t>(16 * 1024, payload.size() - pos));
+        return ok && pipeline.finish() ? pipeline.next().size : 0;
+    };
+    // The first payload fills the pools
+    BOOST_TEST_REQUIRE(decompress() == data.size());
+    const size_t numAllocationsBefore = getNumAllocations();
+    bool ok = true;
+    for(unsigned i = 0; i < 50; i++)
+        ok &= decompress() == data.size();
+    const size_t numSteadyAllocations = getNumAllocations() - numAllocationsBefore;
+    BOOST_TEST(ok);
+    BOOST_TEST(numSteadyAllocations == 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,139 @@
+// Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+//
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "ringQueue.h"
+#include <boost/test/unit_test.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(RingQueueSuite)
+
+BOOST_AUTO_TEST_CASE(CapacityMustBePowerOf2)
+{
+    BOOST_CHECK_THROW(ringQueue::MpmcQueue<int>(0), std::invalid_argument);
+    BOOST_CHECK_THROW(ringQueue::MpmcQueue<int>(1), std::invalid_argument);
+    BOOST_CHECK_THROW(ringQueue::MpmcQueue<int>(12), std::invalid_argument);
+    BOOST_CHECK_NO_THROW(ringQueue::MpmcQueue<int>(16));
+}
+
+BOOST_AUTO_TEST_CASE(KeepsOrderAndBound)
+{
+    ringQueue::MpmcQueue<std::unique_ptr<int>> queue(4);
+    for(int i = 0; i < 4; i++)
+    {
+        auto item = std::make_unique<int>(i);
+        BOOST_TEST_REQUIRE(queue.tryPush(item));
+    }
+    BOOST_TEST(queue.size() == 4u);
+    // A rejected item stays with the caller
+    auto item = std::make_unique<int>(4);
+    BOOST_TEST(!queue.tryPush(item));
+    BOOST_TEST_REQUIRE(item.get() != nullptr);
+    for(int i = 0; i < 4; i++)
+    {
+        std::unique_ptr<int> result;
+        BOOST_TEST_REQUIRE(queue.tryPop(result));
+        BOOST_TEST(*result == i);
+    }
+    std::unique_ptr<int> result;
+    BOOST_TEST(!queue.tryPop(result));
+    // Positions wrap around
+    BOOST_TEST(queue.tryPush(item));
+    BOOST_TEST(queue.tryPop(result));
+    BOOST_TEST(*result == 4);
+}
+
+BOOST_AUTO_TEST_CASE(MovesBatches)
+{
+    ringQueue::MpmcQueue<int> queue(8);
+    std::array<int, 12> items = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    BOOST_TEST(queue.pushBatch(items.data(), items.size()) == 8u);
+    std::array<int, 12> result{};
+    BOOST_TEST(queue.popBatch(result.data(), 5) == 5u);
+    BOOST_TEST(queue.pushBatch(items.data() + 8, 4) == 4u);
+    BOOST_TEST(queue.popBatch(result.data() + 5, result.size()) == 7u);
+    BOOST_TEST(result == items);
+}
+
+BOOST_AUTO_TEST_CASE(CloseDrainsRemainingItems)
+{
+    ringQueue::MpmcQueue<int> queue(4);
+    BOOST_TEST(queue.push(1));
+    BOOST_TEST(queue.push(2));
+    queue.close();
+    BOOST_TEST(!queue.push(3));
+    int item;
+    BOOST_TEST(queue.pop(item));
+    BOOST_TEST(item == 1);
+    BOOST_TEST(queue.pop(item));
+    BOOST_TEST(item == 2);
+    BOOST_TEST(!queue.pop(item));
+}
+
+BOOST_AUTO_TEST_CASE(CloseWakesBlockedThreads)
+{
+    ringQueue::MpmcQueue<int> queue(2);
+    BOOST_TEST(queue.push(1));
+    BOOST_TEST(queue.push(2));
+    std::atomic<bool> pushResult{true};
+    std::thread producer([&queue, &pushResult]() { pushResult = queue.push(3); });
+    ringQueue::MpmcQueue<int> emptyQueue(2);
+    std::atomic<bool> popResult{true};
+    std::thread consumer([&emptyQueue, &popResult]() {
+        int item;
+        popResult = emptyQueue.pop(item);
+    });
+    queue.close();
+    emptyQueue.close();
+    producer.join();
+    consumer.join();
+    BOOST_TEST(!pushResult);
+    BOOST_TEST(!popResult);
+}
+
+BOOST_AUTO_TEST_CASE(HandsEachItemToOneConsumer)
+{
+    constexpr unsigned numThreads = 4;
+    constexpr uint64_t numItems = 100000;
+    ringQueue::MpmcQueue<uint64_t> queue(64);
+    std::atomic<uint64_t> numPopped{0}, sum{0};
+    std::vector<std::thread> producers, consumers;
+    for(unsigned i = 0; i < numThreads; i++)
+    {
+        producers.emplace_back([&queue, i]() {
+            for(uint64_t item = i + 1; item <= numItems; item += numThreads)
+                queue.push(item);
+        });
+        consumers.emplace_back([&queue, &numPopped, &sum]() {
+            std::array<uint64_t, 16> batch;
+            while(true)
+            {
+                size_t count = queue.popBatch(batch.data(), batch.size());
+                if(count == 0)
+                {
+                    if(!queue.pop(batch[0]))
+                        break;
+                    count = 1;
+                }
+                for(size_t j = 0; j < count; j++)
+                    sum += batch[j];
+                numPopped += count;
+            }
+        });
+    }
+    for(std::thread& producer : producers)
+        producer.join();
+    queue.close();
+    for(std::thread& consumer : consumers)
+        consumer.join();
+    BOOST_TEST(numPopped == numItems);
+    BOOST_TEST(sum == numItems * (numItems + 1) / 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
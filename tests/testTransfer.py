@@ -0,0 +1,196 @@
+# Copyright (C) 2005 - 2021 Settlers Freaks <sf-team at siedler25.org>
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+"""Install a generated build with the updater from a server injecting network faults and verify the result.
+
+Usage: testTransfer.py <path to s25update> [unittest arguments]
+"""
+
+import bz2
+import hashlib
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import unittest
+
+from chaosServer import ChaosServer
+
+UPDATER = None
+PLATFORM_PATH = "s25client/nightly/linux.x86_64/updater"
+CHUNK_SIZE = 256 * 1024
+BIG_FILE = "./share/s25rttr/RTTR/big.dat"
+
+
+def createSeekablePayload(data, frameSize=CHUNK_SIZE):
+    """Independently compressed frames followed by their sizes and the number of frames"""
+    payload, seekTable = b"", b""
+    for pos in range(0, len(data), frameSize):
+        frame = bz2.compress(data[pos : pos + frameSize])
+        payload += frame
+        seekTable += struct.pack("<II", len(frame), len(data[pos : pos + frameSize]))
+    return payload + seekTable + struct.pack("<II", len(seekTable) // 8, 0x53325A53)
+
+
+def createBuild(root):
+    """Publish a build with some small files and a large one with chunk hashes. Return the files by their path"""
+    rng = random.Random(25)
+    files = {
+        "./bin/s25client": rng.randbytes(300000),
+        BIG_FILE: rng.randbytes(2 * 1024 * 1024 + 123),
+        "./lib/libfoo.so.1": rng.randbytes(5000),
+    }
+    for i in range(10):
+        files["./share/s25rttr/RTTR/languages/lang%d.po" % i] = ("msg %d\n" % i * rng.randint(10, 200)).encode()
+    updaterPath = os.path.join(root, PLATFORM_PATH)
+    os.makedirs(updaterPath)
+    with open(os.path.join(updaterPath, "files"), "w") as fileList:
+        for path, data in files.items():
+            fileList.write("%s  %s\n" % (hashlib.md5(data).hexdigest(), path))
+            filePath = os.path.join(updaterPath, path)
+            os.makedirs(os.path.dirname(filePath), exist_ok=True)
+            with open(filePath, "wb") as file:
+                file.write(data)
+            with open(filePath + ".bz2", "wb") as file:
+                file.write(bz2.compress(data))
+    with open(os.path.join(updaterPath, "links"), "w") as linkList:
+        linkList.write("./lib/libfoo.so libfoo.so.1\n")
+    data = files[BIG_FILE]
+    chunkHashes = [hashlib.md5(data[pos : pos + CHUNK_SIZE]).hexdigest() for pos in range(0, len(data), CHUNK_SIZE)]
+    with open(os.path.join(updaterPath, "chunks"), "w") as chunkList:
+        rootHash = hashlib.md5("".join(chunkHashes).encode()).hexdigest()
+        chunkList.write("%d %d %s  %s\n" % (len(data), CHUNK_SIZE, rootHash, BIG_FILE))
+        chunkList.write("".join(chunkHash + "\n" for chunkHash in chunkHashes))
+    with open(os.path.join(updaterPath, BIG_FILE) + ".bzs", "wb") as file:
+        file.write(createSeekablePayload(data))
+    return files
+
+
+class TransferTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.tmpDir = tempfile.mkdtemp(prefix="s25update-test")
+        cls.files = createBuild(os.path.join(cls.tmpDir, "www"))
+        cls.server = ChaosServer(os.path.join(cls.tmpDir, "www")).start()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.server.stop()
+        shutil.rmtree(cls.tmpDir)
+
+    def setUp(self):
+        self.installDir = os.path.join(self.tmpDir, self.id().rpartition(".")[2])
+        os.makedirs(self.installDir)
+        self.server.setProfile([])
+
+    def runUpdater(self, *args):
+        cmd = [UPDATER, "--dir", self.installDir, "--server", self.server.url + "/s25client"]
+        cmd += ["--target", "linux", "--arch", "x86_64", "--verbose"] + list(args)
+        startTime = time.monotonic()
+        result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, timeout=120)
+        self.duration = time.monotonic() - startTime
+        self.output = result.stdout.decode(errors="replace")
+        return result.returncode
+
+    def assertInstalled(self):
+        for path, data in self.files.items():
+            with open(os.path.join(self.installDir, path), "rb") as file:
+                self.assertEqual(hashlib.md5(file.read()).hexdigest(), hashlib.md5(data).hexdigest(), path)
+        self.assertEqual(os.readlink(os.path.join(self.installDir, "lib/libfoo.so")), "libfoo.so.1")
+
+    def assertFaultsInjected(self, match):
+        faults = [fault for path, _, fault in self.server.requests if match in path and fault != "ok"]
+        self.assertTrue(faults, "No faults injected for " + match)
+
+    def getRanges(self, match):
+        return [byteRange for path, byteRange, _ in self.server.requests if match in path and byteRange]
+
+    def install(self, profile, *args):
+        self.server.setProfile(profile)
+        self.assertEqual(self.runUpdater(*args), 0, self.output)
+        self.assertInstalled()
+        for rule in profile:
+            self.assertFaultsInjected(rule.get("match", ""))
+
+    def testInstall(self):
+        self.install([])
+        # Nothing is transferred again
+        self.server.setProfile([])
+        self.assertEqual(self.runUpdater(), 0, self.output)
+        self.assertFalse([path for path, _, _ in self.server.requests if path.endswith((".bz2", ".bzs"))])
+
+    def testLatencyAndBandwidth(self):
+        self.install([{"match": "s25client.bz2", "faults": ["slow:200000"]}, {"faults": ["delay:0.2"]}])
+        # The binary takes about 1.5s at the limited rate
+        self.assertGreater(self.duration, 1.4)
+
+    def testResumesResetTransfers(self):
+        self.install([{"match": "s25client.bz2", "faults": ["reset:0.3", "reset:0.6"]}])
+        # Each resumed request starts behind the received data
+        ranges = self.getRanges("s25client.bz2")
+        self.assertEqual(len(ranges), 2)
+        self.assertNotEqual(ranges[0], ranges[1])
+
+    def testResumesTruncatedTransfers(self):
+        self.install([{"match": "s25client.bz2", "faults": ["truncate:0.5"]}])
+        self.assertEqual(len(self.getRanges("s25client.bz2")), 1)
+
+    def testRepeatsServerErrors(self):
+        self.install(
+            [
+                {"match": "s25client.bz2", "faults": ["500", "502", "504"]},
+                {"match": "lang1.po.bz2", "faults": ["429"]},
+                {"match": "lang2.po.bz2", "faults": ["503"]},
+            ]
+        )
+
+    def testAbortsStalledTransfers(self):
+        self.install([{"match": "s25client.bz2", "faults": ["stall:0.5", "stall:0"]}], "--timeout", "2")
+
+    def testRejectsServerIgnoringRange(self):
+        # The resumed request gets the whole file which must not be appended to the received part
+        self.server.setProfile([{"match": "s25client.bz2", "faults": ["reset:0.5", "norange"]}])
+        self.assertNotEqual(self.runUpdater(), 0, self.output)
+        self.assertFaultsInjected("s25client.bz2")
+        self.assertFalse(os.path.exists(os.path.join(self.installDir, "bin/s25client")))
+        self.install([])
+
+    def testGivesUp(self):
+        self.server.setProfile([{"match": "s25client.bz2", "faults": ["500"], "repeat": True}])
+        self.assertNotEqual(self.runUpdater("--retries", "1"), 0, self.output)
+        # The first request and a single retry
+        self.assertEqual(len([fault for _, _, fault in self.server.requests if fault == "500"]), 2)
+        # The next run completes the installation
+        self.install([])
+
+    def testRepairsChunksFromFaultyServer(self):
+        self.install([])
+        bigFile = os.path.join(self.installDir, BIG_FILE)
+        with open(bigFile, "r+b") as file:
+            file.seek(CHUNK_SIZE + 1000)
+            file.write(b"corrupt")
+        self.install([{"match": "big.dat", "faults": ["reset:0.5", "503"]}], "--no-cache")
+
+    def testFallsBackToNextStrategy(self):
+        self.install([])
+        bigFile = os.path.join(self.installDir, BIG_FILE)
+        with open(bigFile, "r+b") as file:
+            file.seek(CHUNK_SIZE + 1000)
+            file.write(b"corrupt")
+        # Chunk repair and the seekable download including its fallback to the whole payload fail.
+        # The full download as the last strategy succeeds
+        profile = [{"match": "big.dat.bz2", "faults": ["500"]}, {"match": "big.dat", "faults": ["500"], "repeat": True}]
+        self.install(profile, "--no-cache", "--retries", "0")
+        self.assertIn("by seekable download failed", self.output)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    UPDATER = os.path.abspath(sys.argv.pop(1))
+    unittest.main()